@@ -0,0 +1,394 @@
+// Microbenchmarks for the primitives of mcigraph.hpp and mcirandom.hpp and
+// the map drawing, generation and pathfinding of the game. Run from the directory
+// containing the images, optionally with a name filter and --csv, e.g.
+//   MCIGraphBench texcache --csv
+// Every optimization in mcigraph.hpp should come with the numbers of this
+// program before and after the change.
+
+#include "mcigraph.hpp"
+#include "map.hpp"
+#include "mapgen.hpp"
+#include "mcibench.hpp"
+#include "mcijobs.hpp"
+#include "mcirandom.hpp"
+#include "pathfind.hpp"
+#include "timers.hpp"
+#include "world.hpp"
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mcigraph::BenchOptions;
+using mcigraph::BenchRunner;
+using mcigraph::TextureLoadCache;
+
+// Writes count small bitmaps to the working directory so the texture cache
+// can be measured with a growing number of keys
+static std::vector<std::string> make_bench_images(int count) {
+  std::vector<std::string> names;
+  SDL_Surface *surface = SDL_CreateRGBSurface(0, 16, 16, 24, 0, 0, 0, 0);
+  if (surface == NULL)
+    throw mcigraph::MciGraphException(SDL_GetError());
+  for (int i = 0; i < count; i++) {
+    std::string name = "bench_tex_" + std::to_string(i) + ".bmp";
+    SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, i, 0, 255 - i));
+    if (SDL_SaveBMP(surface, name.c_str()) != 0) {
+      SDL_FreeSurface(surface);
+      throw mcigraph::MciGraphException(SDL_GetError());
+    }
+    names.push_back(name);
+  }
+  SDL_FreeSurface(surface);
+  return names;
+}
+
+static void remove_bench_images(const std::vector<std::string> &names) {
+  for (auto &name : names)
+    std::remove(name.c_str());
+}
+
+static void bench_texture_cache(BenchRunner &bench, SDL_Renderer *ren) {
+  TextureLoadCache hot(ren);
+  hot.load("grass.bmp");
+  bench.run("texcache_hot_1key", 100000, [&] {
+    for (int i = 0; i < 100000; i++)
+      mcigraph::do_not_optimize(hot.load("grass.bmp"));
+  });
+
+  const int key_counts[] = {1, 16, 128, 1024};
+  auto names = make_bench_images(1024);
+  for (int keys : key_counts) {
+    // Cold: every repetition starts with an empty cache and loads from disc
+    std::unique_ptr<TextureLoadCache> cold;
+    bench.run("texcache_cold_" + std::to_string(keys) + "keys", keys,
+              [&] { cold.reset(new TextureLoadCache(ren)); },
+              [&] {
+                for (int i = 0; i < keys; i++)
+                  mcigraph::do_not_optimize(cold->load(names[i]));
+              });
+    cold.reset();
+
+    // Hot: all keys are cached, only the lookup is measured
+    TextureLoadCache filled(ren);
+    for (int i = 0; i < keys; i++)
+      filled.load(names[i]);
+    const int lookups = 100000;
+    bench.run("texcache_hot_" + std::to_string(keys) + "keys", lookups, [&] {
+      for (int i = 0; i < lookups; i++)
+        mcigraph::do_not_optimize(filled.load(names[i % keys]));
+    });
+  }
+  remove_bench_images(names);
+}
+
+static void bench_drawing(BenchRunner &bench) {
+  const int n = 10000;
+  bench.run("draw_image", n, [&] {
+    for (int i = 0; i < n; i++)
+      draw_image("grass.bmp", (i % 64) * 16, (i / 64 % 48) * 16);
+  });
+  bench.run("draw_rect_fill", n, [&] {
+    for (int i = 0; i < n; i++)
+      draw_rect((i % 64) * 16, (i / 64 % 48) * 16, 16, 16, false, 255, 0, 0);
+  });
+  bench.run("draw_rect_outline", n, [&] {
+    for (int i = 0; i < n; i++)
+      draw_rect((i % 64) * 16, (i / 64 % 48) * 16, 16, 16, true, 255, 0, 0);
+  });
+  bench.run("draw_line", n, [&] {
+    for (int i = 0; i < n; i++)
+      draw_line(0, i % 768, 1023, 767 - i % 768, 255, 0);
+  });
+  present();
+}
+
+static void bench_present(BenchRunner &bench) {
+  // Measure present() without waiting for the display. The window renderer
+  // uses vsync, so this runs on an offscreen context: it has no frame delay
+  // and skips SDL_RenderPresent, which leaves event handling, clearing and
+  // the input snapshot of a frame.
+  mcigraph::Context &window = mcigraph::current();
+  mcigraph::Context offscreen("MCI Graph Bench", 1024, 768, true);
+  mcigraph::set_current(offscreen);
+  const int n = 50;
+  bench.run("present_no_delay", n, [&] {
+    for (int i = 0; i < n; i++)
+      present();
+  });
+  mcigraph::set_current(window);
+}
+
+static void bench_input(BenchRunner &bench) {
+  const int n = 100000;
+  bench.run("is_pressed", n, [&] {
+    int count = 0;
+    for (int i = 0; i < n; i++)
+      count += is_pressed(KEY_A);
+    mcigraph::do_not_optimize(count);
+  });
+  bench.run("was_pressed", n, [&] {
+    int count = 0;
+    for (int i = 0; i < n; i++)
+      count += was_pressed(KEY_A);
+    mcigraph::do_not_optimize(count);
+  });
+}
+
+static void bench_maps(BenchRunner &bench) {
+  Rng rng(1);
+  std::unique_ptr<GameMap> map(new GameMap), map_2(new GameMap), map_3(new GameMap);
+  generate_maps(*map, *map_3, rng);
+  const int n = 10;
+  bench.run("draw_map_1", n * 64 * 48, [&] {
+    for (int i = 0; i < n; i++)
+      draw_map(*map);
+  });
+  bench.run("draw_map_2", n * 64 * 48, [&] {
+    for (int i = 0; i < n; i++)
+      draw_map(*map_2);
+  });
+  bench.run("draw_map_3", n * 64 * 48, [&] {
+    for (int i = 0; i < n; i++)
+      draw_map(*map_3);
+  });
+  present();
+}
+
+// Random directions as used by the monster AI: the old rand() % 4, the
+// per-instance generators and the SSE2 bulk fill
+static void bench_random(BenchRunner &bench) {
+  const int n = 1 << 16;
+  std::vector<uint8_t> directions(n);
+  bench.run("random_dir_rand", n, [&] {
+    for (int i = 0; i < n; i++)
+      directions[i] = static_cast<uint8_t>(rand() % 4);
+    mcigraph::do_not_optimize(directions.data());
+  });
+  std::minstd_rand minstd(1);
+  bench.run("random_dir_minstd", n, [&] {
+    for (int i = 0; i < n; i++)
+      directions[i] = static_cast<uint8_t>(minstd() % 4);
+    mcigraph::do_not_optimize(directions.data());
+  });
+  mcigraph::Pcg32 pcg(1);
+  bench.run("random_dir_pcg32", n, [&] {
+    for (int i = 0; i < n; i++)
+      directions[i] = static_cast<uint8_t>(pcg() & 3);
+    mcigraph::do_not_optimize(directions.data());
+  });
+  mcigraph::Xoshiro256ss xoshiro(1);
+  bench.run("random_dir_xoshiro256", n, [&] {
+    for (int i = 0; i < n; i++)
+      directions[i] = static_cast<uint8_t>(xoshiro() & 3);
+    mcigraph::do_not_optimize(directions.data());
+  });
+  mcigraph::DirectionFill fill(1);
+  bench.run("random_dir_bulk_fill", n, [&] {
+    fill.fill(directions.data(), n);
+    mcigraph::do_not_optimize(directions.data());
+  });
+}
+
+// Generates a 4096x4096 map (64x64 chunks of 64x64 tiles) with the rules of
+// the first game map plus noise terrain, once serially and once on all cores
+static void bench_mapgen(BenchRunner &bench) {
+  std::unique_ptr<DynamicTileMap> world(new DynamicTileMap(4096, 4096));
+  MapGenerator generator(1);
+  generator.noise(0, 0, 4096, 4096, TILE_LAKE, 0.02f, 0.6f)
+      .random(0, 0, 4096, 4096, TILE_LAKE, 300)
+      .random(0, 0, 4096, 4096, TILE_GRAVEL, 20);
+  const int tiles = 4096 * 4096;
+  bench.run("mapgen_4096_serial", tiles, [&] { generator.generate(*world); });
+  int threads = std::thread::hardware_concurrency();
+  WorkerPool pool(threads > 1 ? threads - 1 : 0);
+  bench.run("mapgen_4096_parallel", tiles,
+            [&] { generator.generate(*world, &pool); });
+}
+
+static void bench_pathfind(BenchRunner &bench) {
+  FlowField flow;
+  GameMap small;
+  MapGenerator(1).random(0, 0, 64, 48, TILE_WALL, 5).generate(small);
+  small.block(TILE_WALL);
+  int step = 0;
+  bench.run("flowfield_64x48", 64 * 48, [&] {
+    flow.update(small.collision, step % 64, 24); // every call is a new target
+    step++;
+  });
+
+  std::unique_ptr<DynamicTileMap> world(new DynamicTileMap(1024, 1024));
+  MapGenerator generator(1);
+  generator.noise(0, 0, 1024, 1024, TILE_WALL, 0.05f, 0.62f)
+      .random(0, 0, 1024, 1024, TILE_WALL, 60);
+  generator.generate(*world);
+  world->block(TILE_WALL);
+  bench.run("hpa_build_1024", 1024 * 1024,
+            [&] { HierarchicalPathfinder build(world->collision); });
+
+  mcigraph::Pcg32 rng(1);
+  std::vector<int> queries;
+  while (queries.size() < 4 * 64) {
+    int x = rng.bounded(1024), y = rng.bounded(1024);
+    if (!world->collision.blocked(x, y)) {
+      queries.push_back(x);
+      queries.push_back(y);
+    }
+  }
+  TilePath path;
+  HierarchicalPathfinder uncached(world->collision, 16, 0);
+  bench.run("hpa_query_1024_uncached", 64, [&] {
+    for (size_t i = 0; i < queries.size(); i += 4)
+      uncached.find_path(queries[i], queries[i + 1], queries[i + 2], queries[i + 3], path);
+  });
+  HierarchicalPathfinder cached(world->collision);
+  bench.run("hpa_query_1024_cached", 64, [&] {
+    for (size_t i = 0; i < queries.size(); i += 4)
+      cached.find_path(queries[i], queries[i + 1], queries[i + 2], queries[i + 3], path);
+  });
+  int changed = 0;
+  bench.run("hpa_tile_changed_1024", 1, [&] {
+    int x = (changed * 97) % 1024, y = (changed * 61) % 1024;
+    changed++;
+    cached.tile_changed(x, y);
+    cached.refresh();
+  });
+}
+
+// A horde of monsters on a large map, moved serially and with the job system
+static void bench_jobs(BenchRunner &bench) {
+  int threads = std::thread::hardware_concurrency();
+  mcigraph::JobSystem jobs(threads > 1 ? threads - 1 : 0);
+  std::vector<int> sums(256);
+  bench.run("jobs_parallel_for_empty", 256, [&] {
+    jobs.parallel_for(0, 256, 1, [&](int chunk, int, int) { sums[chunk]++; });
+  });
+
+  std::unique_ptr<DynamicTileMap> world(new DynamicTileMap(1024, 1024));
+  MapGenerator(1).random(0, 0, 1024, 1024, TILE_WALL, 10).generate(*world);
+  world->block(TILE_WALL);
+  const int horde = 1 << 18;
+  Rng rng(1);
+  EntityStore serial(1024, 1024), parallel(1024, 1024);
+  for (int i = 0; i < horde; i++) {
+    int x = rng.bounded(1024), y = rng.bounded(1024);
+    serial.spawn_at(SPRITE_MONSTER, x, y, 100, 0);
+    parallel.spawn_at(SPRITE_MONSTER, x, y, 100, 0);
+  }
+  std::vector<uint8_t> directions(horde);
+  mcigraph::DirectionFill fill(1);
+  fill.fill(directions.data(), horde);
+  bench.run("jobs_horde_move_serial", horde,
+            [&] { move_random(serial, world->collision, directions.data()); });
+  bench.run("jobs_horde_move_parallel", horde, [&] {
+    move_random(parallel, world->collision, directions.data(), &jobs);
+  });
+}
+
+// 100k balls on the free endgame area: one scalar step per ball, the SSE2
+// batch kernel alone, and the full system including the spatial index
+static void bench_balls(BenchRunner &bench) {
+  const int n = 100000;
+  GameMap map;
+  Rng rng(1);
+  EntityStore balls;
+  for (int i = 0; i < n; i++)
+    balls.spawn(SPRITE_BALL1, 1, 0, rng);
+  std::vector<int16_t> xs(balls.x), ys(balls.y);
+  std::vector<uint8_t> flags(balls.flags);
+  bench.run("balls_100k_scalar", n, [&] {
+    for (int i = 0; i < n; i++)
+      bounce_one(xs[i], ys[i], flags[i], map.collision, 63, 43);
+    mcigraph::do_not_optimize(xs.data());
+  });
+  bench.run("balls_100k_batch", n, [&] {
+    bounce_batch(xs.data(), ys.data(), flags.data(), 0, n, map.collision, 63,
+                 43, bounce_area_free(map.collision, 43));
+    mcigraph::do_not_optimize(xs.data());
+  });
+  bench.run("balls_100k_batch_walls", n, [&] {
+    bounce_batch(xs.data(), ys.data(), flags.data(), 0, n, map.collision, 63,
+                 43, false);
+    mcigraph::do_not_optimize(xs.data());
+  });
+  bench.run("balls_100k_system", n,
+            [&] { move_bouncing(balls, map.collision); });
+}
+
+// Pixel-accurate sprite collision: the player mask against a monster mask
+// at every offset of a 48 x 48 pixel window around it, so roughly half of
+// the tests are rejected by the bounding boxes
+static void bench_masks(BenchRunner &bench) {
+  const mcigraph::CollisionMask &player = collision_mask("char1.bmp");
+  const mcigraph::CollisionMask &monster = collision_mask("monster.bmp");
+  const int n = 48 * 48;
+  bench.run("mask_overlap_16x16", n, [&] {
+    int hits = 0;
+    for (int y = -24; y < 24; y++)
+      for (int x = -24; x < 24; x++)
+        hits += mcigraph::masks_overlap(player, 0, 0, monster, x, y);
+    mcigraph::do_not_optimize(hits);
+  });
+  mcigraph::CollisionMask wide(200, 16, true);
+  bench.run("mask_overlap_200x16", n, [&] {
+    int hits = 0;
+    for (int y = -24; y < 24; y++)
+      for (int x = -24; x < 24; x++)
+        hits += mcigraph::masks_overlap(wide, 0, 0, monster, x * 4, y);
+    mcigraph::do_not_optimize(hits);
+  });
+}
+
+// Timer wheel: advancing with 10k pending timers that are far from due,
+// and scheduling plus cancelling
+static void bench_timers(BenchRunner &bench) {
+  TimerWheel wheel;
+  std::vector<TimerFired> fired;
+  for (int i = 0; i < 10000; i++)
+    wheel.schedule(1000000 + i, 0);
+  bench.run("timers_advance_10k_pending", 1000, [&] {
+    for (int i = 0; i < 1000; i++)
+      wheel.advance(fired);
+    mcigraph::do_not_optimize(fired.size());
+  });
+  bench.run("timers_schedule_cancel", 1000, [&] {
+    for (int i = 0; i < 1000; i++)
+      wheel.cancel(wheel.schedule(1 + i % 200, 1));
+  });
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--csv")
+      options.csv = true;
+    else if (arg == "--reps" && i + 1 < argc)
+      options.reps = std::atoi(argv[++i]);
+    else if (arg == "--warmup" && i + 1 < argc)
+      options.warmup = std::atoi(argv[++i]);
+    else
+      options.filter = arg;
+  }
+
+  BenchRunner bench(options);
+  bench_texture_cache(bench, mcigraph::current().ren);
+  bench_drawing(bench);
+  bench_present(bench);
+  bench_input(bench);
+  bench_maps(bench);
+  bench_mapgen(bench);
+  bench_pathfind(bench);
+  bench_jobs(bench);
+  bench_balls(bench);
+  bench_masks(bench);
+  bench_timers(bench);
+  bench_random(bench);
+  return 0;
+}
+
+// Compile (Linux and MacOS):
+// g++ -std=c++11 -O2 -lpthread bench.cpp `sdl2-config --cflags --libs` -o bench
@@ -0,0 +1,188 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+// Begehbarkeit des Spielfelds mit einem Bit pro Kachel (1 = blockiert). Um das
+// Feld liegt ein Rand aus blockierten Kacheln: eine Zeile oben und unten, eine
+// Spalte links und alle Bits rechts bis zum Ende des letzten Worts einer Zeile.
+// Abfragen fuer x in [-1, width] und y in [-1, height] brauchen deshalb keine
+// Bereichspruefung. Bei 64 x 48 Kacheln sind das 2 Woerter pro Zeile und
+// insgesamt 808 Bytes statt 12 KB fuer ein int-Array.
+
+// Richtungen fuer free_run und fuer move_tile in world.hpp. move_random und
+// move_chasing bekommen sie als Zahlen 0 bis 3 aus DirectionFill.
+enum Direction {
+    DIR_UP,
+    DIR_DOWN,
+    DIR_LEFT,
+    DIR_RIGHT
+};
+
+// Bitfunktionen ohne Compiler-Intrinsics, damit sie auch unter Win32 laufen
+inline int lowest_bit(uint64_t v) { // v != 0
+    static const int debruijn[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+    };
+    return debruijn[((v & (0 - v)) * 0x03F79D71B4CB0A89ULL) >> 58];
+}
+
+inline int highest_bit(uint64_t v) { // v != 0
+    v |= v >> 1;
+    v |= v >> 2;
+    v |= v >> 4;
+    v |= v >> 8;
+    v |= v >> 16;
+    v |= v >> 32;
+    return lowest_bit(v ^ (v >> 1));
+}
+
+inline int bit_count(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+}
+
+class CollisionGrid {
+private:
+    int _width, _height;
+    int _stride;                 // Woerter pro Zeile
+    std::vector<uint64_t> _bits; // (height + 2) Zeilen, dazu ein Wort fuer row_bits der letzten Zeile
+    uint64_t* _data;             // _bits oder fremder Speicher (z.B. eine gemappte Leveldatei)
+
+    // Wort und Bit der Kachel (x, y), verschoben um die Randzeile und -spalte
+    size_t word(int x, int y) const {
+        return static_cast<size_t>(y + 1) * _stride + ((x + 1) >> 6);
+    }
+    static int bit(int x) {
+        return (x + 1) & 63;
+    }
+
+public:
+    CollisionGrid(int width = 64, int height = 48)
+        : _width(width), _height(height), _stride((width + 2 + 63) / 64),
+          _bits(word_count(width, height), ~0ULL), _data(_bits.data()) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                set(x, y, false);
+        }
+    }
+
+    // Ansicht auf word_count(width, height) fremde Woerter im selben Layout, ohne Kopie
+    CollisionGrid(int width, int height, uint64_t* words)
+        : _width(width), _height(height), _stride((width + 2 + 63) / 64), _data(words) {}
+
+    CollisionGrid(const CollisionGrid& other)
+        : _width(other._width), _height(other._height), _stride(other._stride), _bits(other._bits),
+          _data(_bits.empty() ? other._data : _bits.data()) {}
+
+    CollisionGrid& operator=(const CollisionGrid& other) {
+        _width = other._width;
+        _height = other._height;
+        _stride = other._stride;
+        _bits = other._bits;
+        _data = _bits.empty() ? other._data : _bits.data();
+        return *this;
+    }
+
+    // Anzahl der Woerter fuer ein Feld dieser Groesse, inklusive Rand
+    static size_t word_count(int width, int height) {
+        return static_cast<size_t>(height + 2) * ((width + 2 + 63) / 64) + 1;
+    }
+
+    const uint64_t* words() const {
+        return _data;
+    }
+
+    // Uebernimmt die Bits eines gleich grossen Gitters
+    void copy_from(const CollisionGrid& other) {
+        std::copy(other._data, other._data + word_count(_width, _height), _data);
+    }
+
+    int width() const {
+        return _width;
+    }
+    int height() const {
+        return _height;
+    }
+
+    // x in [-1, width], y in [-1, height]
+    bool blocked(int x, int y) const {
+        return (_data[word(x, y)] >> bit(x)) & 1;
+    }
+
+    void set(int x, int y, bool is_blocked) {
+        uint64_t mask = 1ULL << bit(x);
+        if (is_blocked)
+            _data[word(x, y)] |= mask;
+        else
+            _data[word(x, y)] &= ~mask;
+    }
+
+    // 64 Kacheln der Zeile y ab x (x in [-1, width]), Bit i entspricht Kachel x + i.
+    // Bits hinter dem rechten Rand haben keine Bedeutung.
+    uint64_t row_bits(int x, int y) const {
+        size_t w = word(x, y);
+        int b = bit(x);
+        uint64_t v = _data[w] >> b;
+        if (b != 0)
+            v |= _data[w + 1] << (64 - b);
+        return v;
+    }
+
+    // Anzahl freier Kacheln, die von (x, y) aus in direction am Stueck
+    // erreichbar sind, hoechstens max.
+    // Waagrecht wird wortweise gesucht, senkrecht Kachel fuer Kachel.
+    int free_run(int x, int y, int direction, int max) const {
+        int run = 0;
+        if (direction == DIR_RIGHT) { // niedrigstes blockiertes Bit rechts von x
+            for (int cx = x + 1; run < max; cx += 64) {
+                uint64_t v = row_bits(cx, y);
+                if (v != 0)
+                    return run + lowest_bit(v) < max ? run + lowest_bit(v) : max;
+                run += 64;
+            }
+            return max;
+        }
+        if (direction == DIR_LEFT) { // hoechstes blockiertes Bit links von x
+            int p = x; // Position von x - 1 im Wort, verschoben um die Randspalte
+            size_t row = static_cast<size_t>(y + 1) * _stride;
+            for (int w = p >> 6; w >= 0; w--) {
+                uint64_t v = _data[row + w];
+                if (w == p >> 6 && (p & 63) != 63)
+                    v &= (1ULL << ((p & 63) + 1)) - 1;
+                if (v != 0) {
+                    run = p - (w * 64 + highest_bit(v));
+                    return run < max ? run : max;
+                }
+            }
+            return max;
+        }
+        int dy = direction == DIR_UP ? -1 : 1;
+        while (run < max && !blocked(x, y + dy * (run + 1)))
+            run++;
+        return run;
+    }
+
+    // true, wenn alle Kacheln x1..x2 der Zeile y frei sind
+    bool row_clear(int x1, int x2, int y) const {
+        return free_run(x1 - 1, y, DIR_RIGHT, x2 - x1 + 1) == x2 - x1 + 1;
+    }
+
+    // Anzahl freier Kacheln in Zeile y
+    int count_free(int y) const {
+        int count = 0;
+        for (int w = 0; w < _stride; w++)
+            count += bit_count(~_data[static_cast<size_t>(y + 1) * _stride + w]);
+        return count;
+    }
+};
+
+#endif /* COLLISION_H */
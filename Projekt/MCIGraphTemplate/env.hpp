@@ -0,0 +1,117 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "game.hpp"
+#include "workers.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Mehrere unabhaengige Spielinstanzen fuer das Training von Bots. GameEnv::step()
+// rechnet fuer jede Instanz einen Spielschritt (FRAMES_PER_STEP Bilder) mit
+// der jeweiligen Aktion, verteilt auf einen Thread-Pool, und schreibt die
+// Beobachtungen aller Instanzen in einen zusammenhaengenden Tensor
+// [Instanz][Kanal][y][x] mit uint8-Werten.
+
+// Kanaele einer Beobachtung
+enum ObsChannel {
+    OBS_TERRAIN, // Kachel der aktuellen Map (0 Gras, 1 See, 2 Kies, 3 Mauer)
+    OBS_PLAYER,  // 1 wo der Spieler steht
+    OBS_MONSTER, // Anzahl Monster auf der Kachel
+    OBS_OBJECT,  // 1 Feuer, 2 Gold, 3 Uhr, 4 Tuer
+    OBS_BALL,    // Anzahl Baelle auf der Kachel
+    OBS_SHOT,    // 1 wo im letzten Tick geschossen wurde
+    OBS_CHANNELS
+};
+
+const int OBS_SIZE = OBS_CHANNELS * 48 * 64; // Bytes pro Instanz
+
+// Schreibt die Beobachtung eines Spiels nach out (OBS_SIZE Bytes)
+inline void write_observation(Game& game, uint8_t* out) {
+    for (int i = 0; i < OBS_SIZE; i++)
+        out[i] = 0;
+    uint8_t* terrain = out + OBS_TERRAIN * 48 * 64;
+    const GameMap& map = game.phase == PHASE_MONSTERS ? game.map : game.phase == PHASE_DOOR ? game.map_2 : game.map_3;
+    std::copy(map.terrain_data(), map.terrain_data() + 48 * 64, terrain);
+
+    out[OBS_PLAYER * 48 * 64 + game.c1.y * 64 + game.c1.x] = 1;
+    for (size_t i = 0; i < game.monsters.size(); i++)
+        out[OBS_MONSTER * 48 * 64 + game.monsters.y[i] * 64 + game.monsters.x[i]]++;
+    for (size_t i = 0; i < game.objects.size(); i++) {
+        uint8_t kind = 1;
+        if (game.objects.sprite[i] == SPRITE_DOOR)
+            kind = 4;
+        else if (game.objects.flags[i] & FLAG_COLLECTABLE)
+            kind = (game.objects.flags[i] & FLAG_RANGE) ? 2 : 3;
+        out[OBS_OBJECT * 48 * 64 + game.objects.y[i] * 64 + game.objects.x[i]] = kind;
+    }
+    for (size_t i = 0; i < game.balls.size(); i++)
+        out[OBS_BALL * 48 * 64 + game.balls.y[i] * 64 + game.balls.x[i]]++;
+    for (auto& step : game.shot_trail)
+        out[OBS_SHOT * 48 * 64 + step.second * 64 + step.first] = 1;
+}
+
+class GameEnv {
+private:
+    std::vector<std::unique_ptr<Game> > _games;
+    std::vector<uint8_t> _observations; // [Instanz][Kanal][y][x]
+    std::vector<uint8_t> _done;         // 1 wenn die Instanz im letzten Schritt geendet hat
+    std::vector<int> _reward;           // abgeschossene Monster im letzten Schritt, +100 Sieg, -100 Niederlage
+    unsigned int _seed;
+    WorkerPool _pool;
+
+public:
+    // n Instanzen, Instanz i startet mit dem Seed seed + i. Beendete Instanzen
+    // werden automatisch mit einem neuen Seed neu gestartet.
+    GameEnv(int n, unsigned int seed, int threads = std::thread::hardware_concurrency())
+        : _observations(n * OBS_SIZE), _done(n), _reward(n), _seed(seed), _pool(threads > 1 ? threads - 1 : 0) {
+        for (int i = 0; i < n; i++)
+            _games.push_back(std::unique_ptr<Game>(new Game(seed + i)));
+        _pool.run(n, [this](int i) { write_observation(*_games[i], &_observations[i * OBS_SIZE]); });
+    }
+
+    int size() {
+        return static_cast<int>(_games.size());
+    }
+
+    // Ein Spielschritt fuer alle Instanzen, actions[i] ist die Eingabe fuer
+    // Instanz i; gehaltene Tasten gelten fuer alle Bilder des Schritts
+    void step(const std::vector<TickInput>& actions) {
+        unsigned int next_seed = _seed + size();
+        _seed = next_seed;
+        _pool.run(size(), [&](int i) {
+            Game& game = *_games[i];
+            int kills = game.monster_kill;
+            for (int frame = 0; frame < FRAMES_PER_STEP && !game.finished(); frame++) {
+                TickInput input = { actions[i].held, frame == 0 ? actions[i].pressed : 0u };
+                game.tick(input);
+            }
+            _reward[i] = game.monster_kill - kills;
+            _done[i] = game.finished();
+            if (game.phase == PHASE_WON)
+                _reward[i] += 100;
+            if (game.phase == PHASE_LOST)
+                _reward[i] -= 100;
+            if (_done[i])
+                _games[i].reset(new Game(next_seed + i));
+            write_observation(*_games[i], &_observations[i * OBS_SIZE]);
+        });
+    }
+
+    const std::vector<uint8_t>& observations() {
+        return _observations;
+    }
+    const std::vector<uint8_t>& done() {
+        return _done;
+    }
+    const std::vector<int>& reward() {
+        return _reward;
+    }
+    Game& game(int i) {
+        return *_games[i];
+    }
+};
+
+#endif /* ENV_H */
@@ -0,0 +1,104 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Ereignisse der Spiellogik. Ein System meldet ein Ereignis genau einmal,
+// wenn es passiert (emit), statt dass jeder Interessent in jedem Tick alle
+// Entitaeten nach dem passenden Zustand durchsucht. Die Verbraucher arbeiten
+// spaeter im selben Spielschritt alle Ereignisse einer Art am Stueck ab, am
+// Ende des Schritts wird der Bus geleert.
+//
+// Jede Ereignisart liegt in ihrer eigenen EventArena. clear() setzt nur den
+// Fuellstand zurueck, der Speicher bleibt erhalten: nach den ersten Ticks
+// wird nichts mehr allokiert und die Kosten haengen nur von der Anzahl der
+// Ereignisse ab, nicht von der Anzahl der Entitaeten.
+//
+// Entitaeten werden ueber ihren Index angesprochen. Das ist sicher, weil
+// EntityStore erst mit flush() am Ende des Ticks Eintraege verschiebt.
+
+// Ebene fuer Ereignisse, die den Spieler statt einer Entitaet betreffen
+const uint8_t EVENT_PLAYER = 0xFF;
+
+// Ein Schuss trifft Entitaet index der Ebene layer
+struct HitEvent {
+    uint8_t layer;
+    uint32_t index;
+    int16_t damage;
+};
+
+// Der Spieler sammelt das Objekt index auf
+struct PickupEvent {
+    uint32_t index;
+};
+
+// Der Spieler erleidet Schaden durch eine Entitaet
+struct DamageEvent {
+    uint8_t layer;
+    uint32_t index;
+};
+
+// Eine Entitaet (oder mit EVENT_PLAYER der Spieler) stirbt
+struct DeathEvent {
+    uint8_t layer;
+    uint32_t index;
+};
+
+// Speicher fuer alle Ereignisse einer Art in einem Spielschritt. Waehrend
+// abgearbeitet wird, duerfen neue Ereignisse dazukommen (ein Treffer kann
+// einen Tod ausloesen), deshalb wird ueber den Index gelaufen.
+template <typename T>
+class EventArena {
+private:
+    std::vector<T> _events;
+
+public:
+    void push(const T& event) {
+        _events.push_back(event);
+    }
+
+    size_t size() const {
+        return _events.size();
+    }
+
+    bool empty() const {
+        return _events.empty();
+    }
+
+    const T& operator[](size_t i) const {
+        return _events[i];
+    }
+
+    void clear() {
+        _events.clear(); // behaelt die Kapazitaet
+    }
+};
+
+// Alle Ereignisarten eines Spiels, events<T>() waehlt die Arena zur Art
+class EventBus : private EventArena<HitEvent>,
+                 private EventArena<PickupEvent>,
+                 private EventArena<DamageEvent>,
+                 private EventArena<DeathEvent> {
+public:
+    template <typename T>
+    EventArena<T>& events() {
+        return *this;
+    }
+
+    template <typename T>
+    void emit(const T& event) {
+        events<T>().push(event);
+    }
+
+    // Am Ende des Spielschritts
+    void clear() {
+        events<HitEvent>().clear();
+        events<PickupEvent>().clear();
+        events<DamageEvent>().clear();
+        events<DeathEvent>().clear();
+    }
+};
+
+#endif /* EVENTS_H */
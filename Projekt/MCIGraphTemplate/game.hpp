@@ -0,0 +1,753 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "mcigraph.hpp"
+#include "map.hpp"
+#include "mapgen.hpp"
+#include "world.hpp"
+#include "collision.hpp"
+#include "level.hpp"
+#include "motion.hpp"
+#include "events.hpp"
+#include "timers.hpp"
+#include <stdlib.h>
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Spiellogik ohne Fenster: Game::tick() rechnet einen Tick (Bewegung, Spawnen,
+// Schiessen, Kollisionen, Objekte, Baelle), Game::draw() zeichnet den Zustand.
+// Damit kann das Spiel auch ohne Zeichnen mit tausenden Ticks pro Sekunde laufen.
+
+// Eingaben eines Ticks als Bitmasken ueber mcigraph::RECORDED_KEYS
+struct TickInput {
+    uint32_t held;    // Tasten, die gerade gedrueckt sind (is_pressed)
+    uint32_t pressed; // Tasten, die seit dem letzten Tick gedrueckt wurden (was_pressed)
+
+    bool is_pressed(int key) const {
+        return (held & mcigraph::recorded_key_bit(key)) != 0;
+    }
+    bool was_pressed(int key) const {
+        return (pressed & mcigraph::recorded_key_bit(key)) != 0;
+    }
+};
+
+// Liest die Eingaben fuer einen Tick aus dem Fenster
+inline TickInput read_input() {
+    TickInput input = { 0, 0 };
+    for (int i = 0; i < mcigraph::RECORDED_KEY_COUNT; i++) {
+        if (is_pressed(mcigraph::RECORDED_KEYS[i]))
+            input.held |= 1u << i;
+        if (was_pressed(mcigraph::RECORDED_KEYS[i]))
+            input.pressed |= 1u << i;
+    }
+    return input;
+}
+
+// Bildrate des Fensters und Anzahl der Bilder pro Spielschritt. Spieler und
+// Gegenstaende, die sich in Pixeln bewegen, werden in jedem Bild gerechnet,
+// Monster, Baelle, Schuesse und Spawns wie bisher zehnmal pro Sekunde.
+const int FRAMES_PER_SECOND = 60;
+const int FRAMES_PER_STEP = 6;
+
+// Weg einer Figur im Bild frame (0 bis FRAMES_PER_STEP - 1) eines
+// Spielschritts. FIXED_ONE ist nicht durch FRAMES_PER_STEP teilbar, den Rest
+// bekommt das letzte Bild, damit ein Schritt genau eine Kachel weit geht und
+// der Spieler auf dem Kachelgitter bleibt.
+constexpr fixed_t frame_speed(long frame) {
+    return frame % FRAMES_PER_STEP == FRAMES_PER_STEP - 1
+        ? FIXED_ONE - (FRAMES_PER_STEP - 1) * (FIXED_ONE / FRAMES_PER_STEP)
+        : FIXED_ONE / FRAMES_PER_STEP;
+}
+
+// Weg in den ersten frames Bildern eines Spielschritts
+constexpr fixed_t step_distance(int frames) {
+    return frames == 0 ? 0 : frame_speed(frames - 1) + step_distance(frames - 1);
+}
+
+static_assert(step_distance(FRAMES_PER_STEP) == FIXED_ONE, "one step must move exactly one tile");
+
+const int MONSTER_HEALTH = 100; // Lebenspunkte eines neuen Monsters
+const int SHOT_DAMAGE = 50;     // Schaden eines Schusses auf ein Monster
+
+class Figure {
+protected:
+    std::string _img;
+    const mcigraph::CollisionMask* _mask;
+public:
+    int x, y; // Kachel, in der der Mittelpunkt liegt
+    Body body;
+
+    // Figuren sind 12 x 12 Pixel gross und stehen mittig in ihrer Kachel,
+    // damit sie ohne pixelgenaues Zielen durch einen Gang von einer Kachel passen
+    static const fixed_t SIZE = 12 * FIXED_PIXEL;
+    static const fixed_t MARGIN = (FIXED_ONE - SIZE) / 2;
+
+    Figure(int x1, int y1, std::string tile) {
+        place(x1, y1);
+        _img = tile;
+        _mask = &sprite_mask(tile);
+    }
+
+    Figure(std::string tile, Rng& rng) {
+        int x1 = rng.bounded(64);
+        place(x1, rng.bounded(48));
+        _img = tile;
+        _mask = &sprite_mask(tile);
+    }
+
+    // Setzt die Figur mittig auf die Kachel (x1, y1)
+    void place(int x1, int y1) {
+        body.x = to_fixed(x1) + MARGIN;
+        body.y = to_fixed(y1) + MARGIN;
+        body.w = body.h = SIZE;
+        body.vx = body.vy = 0;
+        x = x1;
+        y = y1;
+    }
+
+    // Linke obere Ecke des Bildes in Pixeln
+    int pixel_x() const {
+        return fixed_pixel(body.x - MARGIN);
+    }
+    int pixel_y() const {
+        return fixed_pixel(body.y - MARGIN);
+    }
+
+    const mcigraph::CollisionMask& mask() const {
+        return *_mask;
+    }
+
+    void draw_figure() {
+        draw_image(_img, pixel_x(), pixel_y());
+    };
+
+    uint64_t hash(uint64_t h) { // Position in den Zustandshash einrechnen
+        h = mcigraph::hash_state(h, body.x);
+        return mcigraph::hash_state(h, body.y);
+    }
+
+    // Bewegt die Figur mit (vx, vy) gegen das Kachelgitter, x und y folgen dem Mittelpunkt
+    void move(fixed_t vx, fixed_t vy, const CollisionGrid& stop) {
+        body.vx = vx;
+        body.vy = vy;
+        sweep_move(body, stop);
+        x = fixed_tile(body.x + body.w / 2);
+        y = fixed_tile(body.y + body.h / 2);
+    }
+
+    // frame zaehlt die Bilder, siehe frame_speed()
+    void check_movement(const TickInput& input, long frame, int leftkey, int rightkey, int upkey, int downkey, const CollisionGrid& stop) {
+        fixed_t speed = frame_speed(frame);
+        fixed_t vx = 0, vy = 0;
+        if (input.is_pressed(leftkey)) vx -= speed;
+        if (input.is_pressed(rightkey)) vx += speed;
+        if (input.is_pressed(upkey)) vy -= speed;
+        if (input.is_pressed(downkey)) vy += speed;
+        move(vx, vy, stop);
+    }
+
+    void check_movement_endgame(const TickInput& input, long frame, int leftkey, int rightkey, const CollisionGrid& stop) {
+        fixed_t speed = frame_speed(frame);
+        fixed_t vx = 0;
+        if (input.is_pressed(leftkey)) vx -= speed;
+        if (input.is_pressed(rightkey)) vx += speed;
+        move(vx, 0, stop);
+    }
+
+
+
+};
+
+class Player : public Figure {
+private:
+    int _health;
+
+public:
+    Player(int x1, int y1, std::string tile) : Figure(x1, x1, tile) {
+        _health = 100;
+    }
+
+    void draw_figure() {
+        Figure::draw_figure();
+        int px = pixel_x(), py = pixel_y();
+        draw_line(px, py - 3, px + (16.0 / 100) * _health, py - 3, 255, 0);
+        draw_line(px, py - 4, px + (16.0 / 100) * _health, py - 4, 255, 0);
+    }
+    bool damage() {
+        bool dead = false;
+        _health -= 10;
+
+        if (_health == 0) {
+            dead = true;
+            return dead;
+        }
+        return dead;
+    }
+
+    void endgame(int health) {
+        _health = health;
+    }
+
+    uint64_t hash(uint64_t h) {
+        return mcigraph::hash_state(Figure::hash(h), _health);
+    }
+
+};
+
+class Gun : public Figure {
+private:
+    int _range;
+public:
+    Gun(int x1, int y1, std::string tile) : Figure(x1, x1, tile) {
+        _range = 5;
+    }
+
+    void range() {
+        _range += 2;
+    }
+
+    int get_range() {
+        return _range;
+    }
+
+    uint64_t hash(uint64_t h) {
+        return mcigraph::hash_state(Figure::hash(h), _range);
+    }
+
+
+};
+
+// Pixelgenaue Kollision: beruehren sich die undurchsichtigen Pixel der Bilder?
+inline bool are_colliding(Figure* f1, Figure* f2) {
+    return mcigraph::masks_overlap(f1->mask(), f1->pixel_x(), f1->pixel_y(), f2->mask(), f2->pixel_x(), f2->pixel_y());
+}
+
+// Kollision einer Figur mit Entitaet i, die wie in draw_entities an ihrer Kachel gezeichnet wird
+inline bool are_colliding(Figure* f, const EntityStore& store, size_t i) {
+    if (store.flags[i] & FLAG_DESTROYED)
+        return false;
+    return mcigraph::masks_overlap(f->mask(), f->pixel_x(), f->pixel_y(),
+                                   sprite_mask(store.sprite[i]), store.x[i] * 16, store.y[i] * 16);
+}
+
+
+// Ebenen fuer ProjectilePool::fire, Bit i entspricht der i-ten Ebene in raycast()
+enum ShotLayer {
+    LAYER_MONSTERS = 1,
+    LAYER_OBJECTS = 2,
+    LAYER_BALLS = 4
+};
+
+// Index der Ebenen in Ereignissen, Ebene i hat das Bit 1 << i in ShotLayer
+enum LayerIndex {
+    LAYER_INDEX_MONSTERS,
+    LAYER_INDEX_OBJECTS,
+    LAYER_INDEX_BALLS
+};
+
+// Abschnitte des Spiels, in dieser Reihenfolge
+enum Phase {
+    PHASE_MONSTERS, // erste Map, bis 10 Monster abgeschossen wurden
+    PHASE_DOOR,     // Zwischenmap mit der Tuer
+    PHASE_BALLS,    // Endgame mit den Baellen
+    PHASE_WON,      // alle Baelle abgeschossen
+    PHASE_LOST      // Spieler ist gestorben
+};
+
+// Arten der Zeitgeber in Game::timers
+enum TimerKind {
+    TIMER_GUN_READY,    // Abklingzeit der Waffe ist vorbei
+    TIMER_MONSTER_WAVE, // naechstes Monster erscheint
+    TIMER_OBJECT_WAVE,  // naechste Feuerstelle mit Gold und Uhr erscheint
+    TIMER_EXPIRE,       // Objekt (data = Handle) verschwindet
+    TIMER_BALL_STEP     // Baelle bewegen sich
+};
+
+class Game {
+public:
+    int clock = 25; // Abklingzeit der Waffe in Spielschritten
+    int amount_monsters = 0;
+    int amount_balls = 0;
+    int monster_kill = 0;
+    long ticks = 0;  // Spielschritte
+    long frames = 0; // Aufrufe von tick()
+    Phase phase = PHASE_MONSTERS;
+    Rng spawn_rng; // eigene Zufallsstroeme pro Spiel und Subsystem
+    mcigraph::DirectionFill ai_directions;
+
+    Player c1;
+    Gun g1;
+    EntityStore monsters;
+    EntityStore objects;
+    EntityStore balls;
+    Handle door = NO_HANDLE;
+    ProjectilePool projectiles;
+    TimerWheel timers; // Abklingzeiten, Spawns und Lebensdauern, in Spielschritten
+    TimerId gun_timer = NO_TIMER;
+    TimerId monster_wave = NO_TIMER;
+    TimerId object_wave = NO_TIMER;
+    TimerId ball_timer = NO_TIMER;
+    EventBus events; // Treffer, Aufsammeln, Schaden und Tode des aktuellen Spielschritts
+    FlowField monster_flow; // Wege aller Kacheln zum Spieler, neu bei jedem Kachelwechsel
+    mcigraph::JobSystem* jobs = NULL; // wenn gesetzt, laufen grosse Horden parallel
+    std::vector<std::pair<int, int> > shot_trail; // von Schuessen im letzten Tick durchflogene Kacheln
+
+    GameMap map;   // erste Map
+    GameMap map_2; // Zwischenmap, leeres Gras
+    GameMap map_3; // Endgame, Mauern im Hintergrund sind begehbar
+
+    Game(unsigned int seed)
+        : spawn_rng(seed, STREAM_SPAWN), ai_directions(seed, STREAM_AI), c1(32, 24, "char1.bmp"), g1(32, 24, "gun.bmp") {
+        Rng map_rng(seed, STREAM_MAP);
+        generate_maps(map, map_3, map_rng);
+
+        map.block(TILE_WALL); // Wall and Lake nicht begehbar
+        map.block(TILE_LAKE);
+
+        gun_timer = timers.schedule(clock + 1, TIMER_GUN_READY);
+        monster_wave = timers.schedule(monster_wave_delay(), TIMER_MONSTER_WAVE);
+        object_wave = timers.schedule(object_wave_delay(), TIMER_OBJECT_WAVE);
+    }
+
+    // Ersetzt die erste Map durch eine Leveldatei mit 64 x 48 Kacheln und
+    // erzeugt die Monster und Objekte aus deren Spawn-Tabelle
+    void use_level(const LevelFile& level) {
+        const MappedTileMap& level_map = level.map();
+        if (level_map.width() != map.width() || level_map.height() != map.height())
+            throw mcigraph::MciGraphException("Level must have 64 x 48 tiles");
+        map.copy_from(level_map);
+        // Die Kollisionsebene der Datei wird nicht uebernommen: ohne
+        // blockierten Rand liefen Figuren und Strahlen aus dem Feld, deshalb
+        // wie im Konstruktor neu aus dem Gelaende
+        map.collision = CollisionGrid(map.width(), map.height());
+        map.block(TILE_WALL);
+        map.block(TILE_LAKE);
+        monster_flow.invalidate();
+        for (size_t i = 0; i < level.spawn_count(); i++) {
+            const LevelSpawn& spawn = level.spawn(i);
+            if (spawn.x >= 64 || spawn.y >= 48)
+                continue;
+            // Aus der Datei nur die Objekt-Flags, Zustandsbits wie FLAG_DEAD
+            // oder FLAG_DESTROYED setzt allein die Spiellogik, Monster haben keine
+            int object_flags = spawn.flags & (FLAG_COLLECTABLE | FLAG_RANGE | FLAG_CLOCK);
+            if (spawn.sprite == SPRITE_MONSTER) {
+                // Tot ist ein Monster bei genau 0, andere Werte waeren unverwundbar
+                if (spawn.health <= 0 || spawn.health > MONSTER_HEALTH || spawn.health % SHOT_DAMAGE != 0)
+                    continue;
+                monsters.spawn_at(SPRITE_MONSTER, spawn.x, spawn.y, spawn.health, 0);
+                amount_monsters++;
+            }
+            else if (spawn.sprite == SPRITE_FIRE || spawn.sprite == SPRITE_GOLD || spawn.sprite == SPRITE_CLOCK) {
+                if (spawn.health != 0) // Objekte haben keine Lebenspunkte
+                    continue;
+                objects.spawn_at(static_cast<Sprite>(spawn.sprite), spawn.x, spawn.y, 0, object_flags);
+            }
+        }
+    }
+
+    bool finished() {
+        return phase == PHASE_WON || phase == PHASE_LOST;
+    }
+
+    // Rechnet ein Bild, ohne etwas zu zeichnen: der Spieler bewegt sich in
+    // jedem Bild, alle FRAMES_PER_STEP Bilder folgt ein Spielschritt mit allen
+    // seit dem letzten Schritt gedrueckten Tasten
+    void tick(const TickInput& input) {
+        _pressed |= input.pressed;
+        move_player(input);
+        frames++;
+        if (frames % FRAMES_PER_STEP != 0)
+            return;
+        TickInput step = { input.held, _pressed };
+        _pressed = 0;
+
+        shot_trail.clear();
+        _fired.clear();
+        timers.advance(_fired);
+        for (const TimerFired& timer : _fired)
+            on_timer(timer);
+        if (phase == PHASE_MONSTERS)
+            tick_monsters(step);
+        else if (phase == PHASE_DOOR)
+            tick_door(step);
+        else if (phase == PHASE_BALLS)
+            tick_balls(step);
+        monsters.flush(); // vorgemerkte Entitaeten erst am Ende des Ticks loeschen
+        objects.flush();
+        balls.flush();
+        ticks++;
+    }
+
+    // Zeichnet den aktuellen Zustand
+    void draw() {
+        if (phase == PHASE_MONSTERS) {
+            draw_map(map);
+            draw_entities(monsters, 100); // Monster mit Lebensbalken zeichnen
+            draw_shot();
+            draw_entities(objects); // Objekte zeichnen
+
+            c1.draw_figure();
+
+            int cooldown = timers.remaining(gun_timer); //Balken fuer die Abklingzeit
+            draw_line(0, 1, 5 * cooldown, 1, 255, 0, 0);
+            draw_line(0, 2, 5 * cooldown, 2, 255, 0, 0);
+            draw_line(0, 3, 5 * cooldown, 3, 255, 0, 0);
+            draw_line(0, 4, 5 * cooldown, 4, 255, 0, 0);
+        }
+        else if (phase == PHASE_DOOR) {
+            draw_map(map_2);
+            draw_entities(objects); // nur die Tuer
+            c1.draw_figure();
+        }
+        else {
+            draw_map(map_3);
+            c1.draw_figure();
+            draw_shot();
+            draw_entities(balls); // Baelle zeichnen
+        }
+    }
+
+    // Hash ueber den gesamten Spielzustand, wird pro Frame an das Replay gemeldet
+    uint64_t state_hash() {
+        uint64_t h = mcigraph::STATE_HASH_SEED;
+        h = c1.hash(h);
+        h = g1.hash(h);
+        h = monsters.hash(h);
+        h = objects.hash(h);
+        h = balls.hash(h);
+        h = projectiles.hash(h);
+        h = mcigraph::hash_state(h, clock);
+        return timers.hash(h);
+    }
+
+private:
+    // Bewegt alle fliegenden Schuesse um einen Tick weiter
+    void advance_projectiles(const CollisionGrid& map_stop) {
+        EntityStore* layers[] = { &monsters, &objects, &balls };
+        projectiles.advance(map_stop, layers, 3, shot_trail, events.events<HitEvent>());
+    }
+
+    EntityStore& layer(int index) {
+        return index == LAYER_INDEX_MONSTERS ? monsters : index == LAYER_INDEX_OBJECTS ? objects : balls;
+    }
+
+    // Verbraucher aller bisher gemeldeten Ereignisse, danach ist der Bus leer.
+    // Treffer und Schaden koennen Tode ausloesen, deshalb kommen die Tode zuletzt.
+    void process_events() {
+        const EventArena<HitEvent>& hits = events.events<HitEvent>();
+        for (size_t k = 0; k < hits.size(); k++) { // Schaden durch Schuesse, bei genau 0 tot
+            EntityStore& store = layer(hits[k].layer);
+            size_t i = hits[k].index;
+            store.health[i] -= hits[k].damage;
+            if (store.health[i] == 0) {
+                store.flags[i] |= FLAG_DEAD;
+                DeathEvent death = { hits[k].layer, hits[k].index };
+                events.emit(death);
+            }
+        }
+
+        const EventArena<PickupEvent>& pickups = events.events<PickupEvent>();
+        for (size_t k = 0; k < pickups.size(); k++) {
+            size_t i = pickups[k].index;
+            objects.destroy(i);
+            if (objects.flags[i] & FLAG_RANGE) // Goldbarren fuer mehr Reichweite
+                g1.range();
+            if (objects.flags[i] & FLAG_CLOCK) { // Objekt fuer weniger Verzoegerung zwischen den Schuessen, auch die laufende wird kuerzer
+                clock -= 2;
+                timers.reschedule(gun_timer, timers.remaining(gun_timer) - 2);
+            }
+        }
+
+        const EventArena<DamageEvent>& damage = events.events<DamageEvent>();
+        for (size_t k = 0; k < damage.size(); k++) {
+            if (c1.damage()) {
+                DeathEvent death = { EVENT_PLAYER, 0 };
+                events.emit(death);
+            }
+        }
+
+        const EventArena<DeathEvent>& deaths = events.events<DeathEvent>();
+        for (size_t k = 0; k < deaths.size(); k++) {
+            if (deaths[k].layer == EVENT_PLAYER) {
+                phase = PHASE_LOST;
+                continue;
+            }
+            layer(deaths[k].layer).destroy(deaths[k].index);
+            if (deaths[k].layer == LAYER_INDEX_MONSTERS)
+                monster_kill++;
+        }
+
+        events.clear();
+    }
+
+    std::vector<uint8_t> _directions; // Richtungen der Monster im aktuellen Tick
+    uint32_t _pressed = 0;            // seit dem letzten Spielschritt gedrueckte Tasten
+    std::vector<size_t> _candidates, _touching; // fuer touching()
+    std::vector<TimerFired> _fired;             // im aktuellen Spielschritt faellige Zeitgeber
+    bool _ball_step = false;                    // TIMER_BALL_STEP ist in diesem Schritt faellig
+    static const int CHASE_RANGE = 8; // Schritte, ab denen ein Monster den Spieler bemerkt
+
+    void draw_shot() {
+        for (auto& step : shot_trail)
+            draw_image("gun.bmp", step.first * 16, step.second * 16);
+    }
+
+    bool player_at(const EntityStore& store, size_t i) {
+        return store.x[i] == c1.x && store.y[i] == c1.y && (store.flags[i] & FLAG_DESTROYED) == 0;
+    }
+
+    // Abstaende der Spawns, im Mittel wie bisher ein Monster alle 5 und neue
+    // Objekte alle 55 Spielschritte
+    int monster_wave_delay() {
+        return 1 + spawn_rng.bounded(9);
+    }
+    int object_wave_delay() {
+        return 1 + spawn_rng.bounded(109);
+    }
+
+    // Objekt mit Obergrenze, das nach POPULATION[image].lifetime Schritten verschwindet
+    void spawn_object(Sprite image, int entity_flags) {
+        Handle h = spawn_limited(objects, image, 0, entity_flags, spawn_rng);
+        if (h.slot != NO_HANDLE.slot && POPULATION[image].lifetime > 0)
+            timers.schedule(POPULATION[image].lifetime, TIMER_EXPIRE, (static_cast<uint64_t>(h.slot) << 32) | h.generation);
+    }
+
+    // Verteilt einen faelligen Zeitgeber, am Anfang des Spielschritts
+    void on_timer(const TimerFired& timer) {
+        switch (timer.kind) {
+        case TIMER_MONSTER_WAVE:
+            if (amount_monsters < 20) { // 20 Monster erstellen
+                monsters.spawn(SPRITE_MONSTER, MONSTER_HEALTH, 0, spawn_rng);
+                amount_monsters++;
+            }
+            monster_wave = timers.schedule(monster_wave_delay(), TIMER_MONSTER_WAVE);
+            break;
+        case TIMER_OBJECT_WAVE: // Objecte erstellen, hoechstens POPULATION[...].cap pro Art
+            spawn_object(SPRITE_FIRE, 0);
+            spawn_object(SPRITE_GOLD, FLAG_COLLECTABLE | FLAG_RANGE);
+            spawn_object(SPRITE_CLOCK, FLAG_COLLECTABLE | FLAG_CLOCK);
+            object_wave = timers.schedule(object_wave_delay(), TIMER_OBJECT_WAVE);
+            break;
+        case TIMER_EXPIRE: { // liegengebliebene Objekte verschwinden, aufgesammelte haben ein ungueltiges Handle
+            Handle h = { static_cast<uint32_t>(timer.data >> 32), static_cast<uint32_t>(timer.data) };
+            objects.destroy(h);
+            break;
+        }
+        case TIMER_BALL_STEP:
+            _ball_step = true;
+            ball_timer = timers.schedule(2, TIMER_BALL_STEP);
+            break;
+        default: // TIMER_GUN_READY, gun_timer ist jetzt nicht mehr pending
+            break;
+        }
+    }
+
+    // Was bei einer Beruehrung mit dem Spieler passiert, nach Sprite der Entitaet.
+    // Die Handler melden nur Ereignisse, ausgewertet wird in process_events().
+    typedef void (Game::*ContactHandler)(int index, size_t i);
+
+    void contact_none(int, size_t) {}
+
+    void contact_damage(int index, size_t i) { // Monster und Feuerstellen
+        DamageEvent hurt = { static_cast<uint8_t>(index), static_cast<uint32_t>(i) };
+        events.emit(hurt);
+    }
+
+    void contact_pickup(int, size_t i) { // Gold und Uhr
+        PickupEvent pickup = { static_cast<uint32_t>(i) };
+        events.emit(pickup);
+    }
+
+    void contact_death(int, size_t) { // Baelle
+        DeathEvent death = { EVENT_PLAYER, 0 };
+        events.emit(death);
+    }
+
+    static ContactHandler contact_handler(int sprite) {
+        static const ContactHandler handlers[SPRITE_COUNT] = {
+            &Game::contact_damage, // SPRITE_MONSTER
+            &Game::contact_damage, // SPRITE_FIRE
+            &Game::contact_pickup, // SPRITE_GOLD
+            &Game::contact_pickup, // SPRITE_CLOCK
+            &Game::contact_none,   // SPRITE_DOOR, siehe tick_door()
+            &Game::contact_death,  // SPRITE_BALL1
+            &Game::contact_death   // SPRITE_BALL2
+        };
+        return handlers[sprite];
+    }
+
+    // Alle Beruehrungen des Spielers mit einer Ebene in einem Durchgang: ueber
+    // den Raumindex werden nur die Entitaeten unter dem Spieler betrachtet, die
+    // Kosten haengen also nicht von der Anzahl der Entitaeten ab. Aufgesammelte
+    // Objekte werden nur vorgemerkt und mit flush() am Ende des Ticks entfernt.
+    void resolve_contacts(int index) {
+        EntityStore& store = layer(index);
+        for (size_t i : touching(store))
+            (this->*contact_handler(store.sprite[i]))(index, i);
+    }
+
+    // Indizes aller Entitaeten, deren Bild das Bild des Spielers pixelgenau
+    // beruehrt. Gesucht wird nur auf den hoechstens 2 x 2 Kacheln unter dem Bild.
+    const std::vector<size_t>& touching(const EntityStore& store) {
+        _candidates.clear();
+        _touching.clear();
+        fixed_t left = c1.body.x - Figure::MARGIN, top = c1.body.y - Figure::MARGIN;
+        store.query_rect(fixed_tile(left), fixed_tile(top),
+                         fixed_tile(left + FIXED_ONE - 1), fixed_tile(top + FIXED_ONE - 1), _candidates);
+        for (size_t i : _candidates) {
+            if (are_colliding(&c1, store, i))
+                _touching.push_back(i);
+        }
+        return _touching;
+    }
+
+    // Bewegung des Spielers in einem Bild, je nach Abschnitt
+    void move_player(const TickInput& input) {
+        if (phase == PHASE_MONSTERS) {
+            c1.check_movement(input, frames, KEY_A, KEY_D, KEY_W, KEY_S, map.collision);
+        }
+        else if (phase == PHASE_DOOR) {
+            if (!player_at(objects, objects.index_of(door))) // auf der Tuer stehen bleiben bis zum naechsten Schritt
+                c1.check_movement(input, frames, KEY_A, KEY_D, KEY_W, KEY_S, map_2.collision);
+        }
+        else if (phase == PHASE_BALLS) {
+            c1.check_movement_endgame(input, frames, KEY_LEFT, KEY_RIGHT, map_3.collision); // nur mehr rechts links moeglich und ab jetzt mit den Pfeiltasten
+        }
+    }
+
+    void tick_monsters(const TickInput& input) { // erste Map laeuft so lange, bis 10 Monster abgechossen wurden
+
+        _directions.resize(monsters.size()); // Monster in der Naehe verfolgen den Spieler, sonst bewegen sie sich unwillkuerlich
+        ai_directions.fill(_directions.data(), _directions.size());
+        monster_flow.update(map.collision, c1.x, c1.y);
+        move_chasing(monsters, map.collision, monster_flow, CHASE_RANGE, _directions.data(), ticks % 2, jobs);
+
+        // Schiessen mit den Pfeiltasten, pro Tick hoechstens ein Schuss in dieser Reihenfolge
+        static const int shots[4][2] = {
+            { KEY_LEFT, DIR_LEFT }, { KEY_RIGHT, DIR_RIGHT }, { KEY_UP, DIR_UP }, { KEY_DOWN, DIR_DOWN }
+        };
+        for (auto& shot : shots) {
+            if (input.was_pressed(shot[0]) && !timers.pending(gun_timer)) { // Verzoegerung, damit man nicht durchgehend schiessen kann
+                if (projectiles.fire(c1.x, c1.y, shot[1], g1.get_range(), 2, LAYER_MONSTERS, SHOT_DAMAGE)) // holt sich die Reichweite des Schusses
+                    gun_timer = timers.schedule(clock + 1, TIMER_GUN_READY);
+            }
+        }
+        advance_projectiles(map.collision); // Schuesse fliegen zwei Kacheln pro Tick
+
+        resolve_contacts(LAYER_INDEX_MONSTERS); // Kollision mit Monster
+        resolve_contacts(LAYER_INDEX_OBJECTS);  // Gold, Uhr und Feuerstellen
+
+        process_events(); // Schaden, Aufsammeln und Loeschen von Monstern
+        if (phase == PHASE_LOST)
+            return;
+
+        if (monster_kill >= 10) { //Zwischenmap
+            objects.clear(); // Loesche alle Objekte, ihre TIMER_EXPIRE laufen ins Leere
+            timers.cancel(monster_wave);
+            timers.cancel(object_wave);
+            projectiles.clear();
+            door = objects.spawn(SPRITE_DOOR, 0, 0, spawn_rng); // Erstellung einer Tuer, die irgendwo am Spielfeld erscheint
+            phase = PHASE_DOOR;
+        }
+    }
+
+    void tick_door(const TickInput&) { // diese Map mit der Tuer wird angezeigt, bis der Spieler in die Tuer eintritt
+        size_t d = objects.index_of(door);
+        if (player_at(objects, d)) { // Nach dem Eintritt in die Tuer erscheint eine neue Map und ein neues Spiel
+            monsters.clear(); // alle Monster entfernen
+            c1.place(0, 43);
+            c1.endgame(0); // Charakter hat nun nur mehr ein Leben
+            timers.cancel(gun_timer);
+            gun_timer = timers.schedule(clock / 2 + 1, TIMER_GUN_READY);
+            ball_timer = timers.schedule(1, TIMER_BALL_STEP); // ab dem ersten Schritt jeden zweiten
+            phase = PHASE_BALLS;
+        }
+    }
+
+    void tick_balls(const TickInput& input) {
+        if (amount_balls < 5) { // Baelle erstellen
+            balls.spawn(SPRITE_BALL1, 2, 0, spawn_rng); // dieser Ball muss zweimal getroffen werden
+            balls.spawn(SPRITE_BALL2, 1, 0, spawn_rng); // dieser Ball muss nur einmal getroffen werden
+            amount_balls++;
+        }
+
+
+        if (input.was_pressed(KEY_SPACE)) { // mit der Leertaste wird ein Schuss nach oben abgegeben
+            if (!timers.pending(gun_timer)) {
+                if (projectiles.fire(c1.x, c1.y, DIR_UP, 44, 4, LAYER_BALLS, 1))
+                    gun_timer = timers.schedule(clock / 2 + 1, TIMER_GUN_READY);
+            }
+
+        }
+        advance_projectiles(map_3.collision); // Schuesse fliegen vier Kacheln pro Tick
+        process_events(); // Loeschen von Baellen
+
+        if (_ball_step) { // Baelle bewegen
+            move_bouncing(balls, map_3.collision, jobs);
+            _ball_step = false;
+        }
+
+        resolve_contacts(LAYER_INDEX_BALLS); // Charakter wird vom Ball getroffen
+        process_events();
+        if (phase == PHASE_LOST)
+            return;
+
+        if (balls.live() == 0) { // alle Baelle sind abgeschossen
+            phase = PHASE_WON;
+            return;
+        }
+    }
+};
+
+// Misst die Ticks pro Sekunde, die Rate wird jeweils nach window_seconds neu berechnet
+class TickRateMeter {
+private:
+    std::chrono::steady_clock::time_point _start;
+    long _ticks;
+    double _rate;
+
+public:
+    TickRateMeter() : _start(std::chrono::steady_clock::now()), _ticks(0), _rate(0) {}
+
+    // Einen Tick zaehlen, gibt true zurueck, wenn eine neue Rate berechnet wurde
+    bool tick(double window_seconds = 1.0) {
+        _ticks++;
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - _start).count();
+        if (elapsed < window_seconds)
+            return false;
+        _rate = _ticks / elapsed;
+        _ticks = 0;
+        _start = now;
+        return true;
+    }
+
+    double rate() {
+        return _rate;
+    }
+};
+
+// Laesst das Spiel ohne Fenster fuer n Ticks laufen. Die Eingaben kommen von
+// input(game), ein beendetes Spiel wird durch ein neues (mit seed + 1) ersetzt. Jede Sekunde
+// wird die aktuelle Tickrate ausgegeben, zurueckgegeben wird der Durchschnitt.
+template <typename InputFn>
+double run_ticks(long n, unsigned int seed, InputFn input) {
+    std::unique_ptr<Game> game(new Game(seed));
+    TickRateMeter meter;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < n; i++) {
+        if (game->finished())
+            game.reset(new Game(++seed));
+        game->tick(input(*game));
+        if (meter.tick())
+            printf("%.0f ticks/s\n", meter.rate());
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return elapsed > 0 ? n / elapsed : 0;
+}
+
+#endif /* GAME_H */
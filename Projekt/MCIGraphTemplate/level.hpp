@@ -0,0 +1,238 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include "mcigraph.hpp"
+#include "map.hpp"
+#include "collision.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Leveldateien (.lvl) mit fertigen Karten beliebiger Groesse. Die Datei wird
+// per mmap geoeffnet und die Ebenen werden direkt als Speicher einer
+// MappedTileMap benutzt, es wird nichts eingelesen oder umgewandelt. Die
+// Zuordnung ist copy-on-write: Aenderungen an der Karte landen nicht in der Datei.
+//
+// Aufbau (little endian, alle Abschnitte auf 64 Bytes ausgerichtet):
+//   Kopf, LEVEL_HEADER_SIZE Bytes:
+//     "MCIL", u32 Version, u32 Breite, u32 Hoehe,
+//     u64 Offset Gelaende, u64 Offset Verzierungen, u64 Offset Kollision,
+//     u64 Offset Spawn-Tabelle, u32 Anzahl Spawns, Rest 0
+//   Gelaende:      Breite * Hoehe Bytes (Tile)
+//   Verzierungen:  Breite * Hoehe Bytes (Tile, TILE_NONE wenn leer)
+//   Kollision:     CollisionGrid::word_count(Breite, Hoehe) u64 im Layout von CollisionGrid
+//   Spawn-Tabelle: je 8 Bytes: u16 x, u16 y, u8 Sprite, u8 Flags, i16 Lebenspunkte
+
+const uint32_t LEVEL_VERSION = 1;
+const size_t LEVEL_HEADER_SIZE = 64;
+const size_t LEVEL_ALIGN = 64;
+const int LEVEL_MAX_SIDE = 4096; // groesste Breite bzw. Hoehe in Kacheln
+
+// Eintrag der Spawn-Tabelle, Sprite und Flags wie in world.hpp
+struct LevelSpawn {
+    uint16_t x, y;
+    uint8_t sprite;
+    uint8_t flags;
+    int16_t health;
+};
+
+static_assert(sizeof(LevelSpawn) == 8, "LevelSpawn must match the file layout");
+
+inline size_t level_align(size_t offset) {
+    return (offset + LEVEL_ALIGN - 1) / LEVEL_ALIGN * LEVEL_ALIGN;
+}
+
+// Schreibt eine Karte mit Spawn-Tabelle als Leveldatei, z.B. die Ausgabe von generate_maps
+template <typename Map>
+void write_level(const std::string& filename, const Map& map, const std::vector<LevelSpawn>& spawns) {
+    size_t tiles = static_cast<size_t>(map.width()) * map.height();
+    size_t terrain = LEVEL_HEADER_SIZE;
+    size_t decoration = level_align(terrain + tiles);
+    size_t collision = level_align(decoration + tiles);
+    size_t spawn_table = level_align(collision + CollisionGrid::word_count(map.width(), map.height()) * 8);
+    size_t size = spawn_table + spawns.size() * sizeof(LevelSpawn);
+
+    std::vector<uint8_t> out;
+    out.reserve(size);
+    out.insert(out.end(), { 'M', 'C', 'I', 'L' });
+    mcigraph::put_le(out, LEVEL_VERSION, 4);
+    mcigraph::put_le(out, map.width(), 4);
+    mcigraph::put_le(out, map.height(), 4);
+    mcigraph::put_le(out, terrain, 8);
+    mcigraph::put_le(out, decoration, 8);
+    mcigraph::put_le(out, collision, 8);
+    mcigraph::put_le(out, spawn_table, 8);
+    mcigraph::put_le(out, spawns.size(), 4);
+    out.resize(terrain, 0);
+    out.insert(out.end(), map.terrain_data(), map.terrain_data() + tiles);
+    out.resize(decoration, 0);
+    out.insert(out.end(), map.decoration_data(), map.decoration_data() + tiles);
+    out.resize(collision, 0);
+    const uint64_t* words = map.collision.words();
+    for (size_t i = 0; i < CollisionGrid::word_count(map.width(), map.height()); i++)
+        mcigraph::put_le(out, words[i], 8);
+    out.resize(spawn_table, 0);
+    for (const LevelSpawn& spawn : spawns) {
+        mcigraph::put_le(out, spawn.x, 2);
+        mcigraph::put_le(out, spawn.y, 2);
+        mcigraph::put_le(out, spawn.sprite, 1);
+        mcigraph::put_le(out, spawn.flags, 1);
+        mcigraph::put_le(out, static_cast<uint16_t>(spawn.health), 2);
+    }
+
+    std::FILE* file = std::fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        throw mcigraph::MciGraphException("Could not open level file for writing: " + filename);
+    size_t written = std::fwrite(out.data(), 1, out.size(), file);
+    std::fclose(file);
+    if (written != out.size())
+        throw mcigraph::MciGraphException("Could not write level file: " + filename);
+}
+
+// Eine per mmap geoeffnete Leveldatei, die Karte bleibt gueltig, solange das Objekt lebt
+class LevelFile {
+private:
+    uint8_t* _data = NULL;
+    size_t _size = 0;
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = NULL;
+#endif
+    MappedTileMap* _map = NULL;
+    const LevelSpawn* _spawns = NULL;
+    size_t _spawn_count = 0;
+
+    void fail(const std::string& message) {
+        close();
+        throw mcigraph::MciGraphException(message);
+    }
+
+    // Liegen length Bytes ab offset vollstaendig in der Datei?
+    bool fits(size_t offset, size_t length) const {
+        return offset <= _size && length <= _size - offset;
+    }
+
+    void close() {
+        delete _map;
+        _map = NULL;
+#ifdef _WIN32
+        if (_data != NULL)
+            UnmapViewOfFile(_data);
+        if (_mapping != NULL)
+            CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE)
+            CloseHandle(_file);
+        _mapping = NULL;
+        _file = INVALID_HANDLE_VALUE;
+#else
+        if (_data != NULL)
+            munmap(_data, _size);
+#endif
+        _data = NULL;
+    }
+
+public:
+    LevelFile(const std::string& filename) {
+#ifdef _WIN32
+        _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+            fail("Could not open level file: " + filename);
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size))
+            fail("Could not read size of level file: " + filename);
+        _size = static_cast<size_t>(size.QuadPart);
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (_mapping == NULL)
+            fail("Could not map level file: " + filename);
+        _data = static_cast<uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0));
+        if (_data == NULL)
+            fail("Could not map level file: " + filename);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            fail("Could not open level file: " + filename);
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            fail("Could not read size of level file: " + filename);
+        }
+        _size = static_cast<size_t>(info.st_size);
+        void* data = _size > 0 ? mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (data == MAP_FAILED)
+            fail("Could not map level file: " + filename);
+        _data = static_cast<uint8_t*>(data);
+#endif
+
+        // Geprueft werden der Kopf und die Lage der Ebenen, ihr Inhalt wird
+        // unveraendert benutzt (Game::use_level baut die Kollision neu auf)
+        if (_size < LEVEL_HEADER_SIZE || _data[0] != 'M' || _data[1] != 'C' || _data[2] != 'I' || _data[3] != 'L')
+            fail("Not a level file: " + filename);
+        if (mcigraph::get_le(_data + 4, 4) != LEVEL_VERSION)
+            fail("Unsupported level version: " + filename);
+        int width = static_cast<int>(mcigraph::get_le(_data + 8, 4));
+        int height = static_cast<int>(mcigraph::get_le(_data + 12, 4));
+        size_t terrain = static_cast<size_t>(mcigraph::get_le(_data + 16, 8));
+        size_t decoration = static_cast<size_t>(mcigraph::get_le(_data + 24, 8));
+        size_t collision = static_cast<size_t>(mcigraph::get_le(_data + 32, 8));
+        size_t spawn_table = static_cast<size_t>(mcigraph::get_le(_data + 40, 8));
+        _spawn_count = static_cast<size_t>(mcigraph::get_le(_data + 48, 4));
+        // Erst die Groesse begrenzen, damit tiles und word_count nicht
+        // ueberlaufen, dann jede Ebene als offset + length <= _size pruefen,
+        // ohne die Summe zu bilden (ein riesiger Offset wuerde umbrechen)
+        if (width <= 0 || height <= 0 || width > LEVEL_MAX_SIDE || height > LEVEL_MAX_SIDE)
+            fail("Corrupt level file: " + filename);
+        size_t tiles = static_cast<size_t>(width) * height;
+        if (!fits(terrain, tiles) || !fits(decoration, tiles) ||
+            collision % 8 != 0 || !fits(collision, CollisionGrid::word_count(width, height) * 8) ||
+            spawn_table % 2 != 0 || spawn_table > _size ||
+            _spawn_count > (_size - spawn_table) / sizeof(LevelSpawn))
+            fail("Corrupt level file: " + filename);
+
+        MappedTileStorage storage(width, height, _data + terrain, _data + decoration);
+        CollisionGrid grid(width, height, reinterpret_cast<uint64_t*>(_data + collision));
+        _map = new MappedTileMap(storage, grid);
+        _spawns = reinterpret_cast<const LevelSpawn*>(_data + spawn_table);
+    }
+
+    ~LevelFile() {
+        close();
+    }
+
+    MappedTileMap& map() {
+        return *_map;
+    }
+    const MappedTileMap& map() const {
+        return *_map;
+    }
+
+    size_t spawn_count() const {
+        return _spawn_count;
+    }
+    const LevelSpawn& spawn(size_t i) const {
+        return _spawns[i];
+    }
+
+private:
+    LevelFile(const LevelFile&);
+    LevelFile& operator=(const LevelFile&);
+};
+
+#endif /* LEVEL_H */
@@ -1,614 +1,223 @@
 #include "mcigraph.hpp"
+#include "game.hpp"
+#include "env.hpp"
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <chrono>
+#include <memory>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 
 using namespace std;
 
-class Figure {
-protected:
-    string _img;
-public:
-    int x, y;
+// Zufaellige Eingaben fuer Soak-Tests ohne Fenster, unabhaengig vom Zufallsgenerator des Spiels
+struct RandomInput {
+    mt19937 bot;
 
-    Figure(int x1, int y1, string tile) {
-        x = x1;
-        y = y1;
-        _img = tile;
-    }
-
-    Figure(string tile) {
-        x = rand() % 64;
-        y = rand() % 48;
-        _img = tile;
-    }
-
-
-    void draw_figure() {
-        draw_image(_img, x * 16, y * 16);
-    };
-
-    void move_up(int* stop) {
-        y--;
-        if (stop[y * 64 + x] == 1 || y < 0) y++;
-    }
-    void move_down(int* stop) {
-        y++;
-        if (stop[y * 64 + x] == 1 || y > 47) y--;
-    }
-    void move_left(int* stop) {
-        x--;
-        if (stop[y * 64 + x] == 1 || x < 0) x++;
-    }
-    void move_right(int* stop) {
-        x++;
-        if (stop[y * 64 + x] == 1 || x > 63) x--;
-    }
-
-    void check_movement(int leftkey, int rightkey, int upkey, int downkey, int* stop) {
-        if (is_pressed(leftkey)) move_left(stop);
-        if (is_pressed(upkey)) move_up(stop);
-        if (is_pressed(downkey)) move_down(stop);
-        if (is_pressed(rightkey)) move_right(stop);
-
-    }
+    RandomInput(unsigned int seed) : bot(seed) {}
 
-    void check_movement_endgame(int leftkey, int rightkey, int* stop) {
-        if (is_pressed(leftkey)) move_left(stop);
-        if (is_pressed(rightkey)) move_right(stop);
-
-    }
-
-
-
-};
-
-class Player : public Figure {
-private:
-    int _health;
-
-public:
-    Player(int x1, int y1, string tile) : Figure(x1, x1, tile) {
-        _health = 100;
-    }
-
-    void draw_figure() {
-        Figure::draw_figure();
-        draw_line(x * 16, y * 16 - 3, x * 16 + (16.0 / 100) * _health, y * 16 - 3, 255, 0);
-        draw_line(x * 16, y * 16 - 4, x * 16 + (16.0 / 100) * _health, y * 16 - 4, 255, 0);
-    }
-    bool damage() {
-        bool dead = false;
-        _health -= 10;
-
-        if (_health == 0) {
-            dead = true;
-            return dead;
+    TickInput operator()(Game&) {
+        const int move_keys[] = { KEY_W, KEY_A, KEY_S, KEY_D };
+        const int shoot_keys[] = { KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN };
+        TickInput input = { 0, 0 };
+        for (int key : move_keys) {
+            if (bot() % 2 == 0)
+                input.held |= mcigraph::recorded_key_bit(key);
         }
-        return dead;
+        if (bot() % 4 == 0)
+            input.pressed = mcigraph::recorded_key_bit(shoot_keys[bot() % 4]) | mcigraph::recorded_key_bit(KEY_SPACE);
+        return input;
     }
-
-    void endgame(int health) {
-        _health = health;
-    }
-
 };
 
-class Ball : public Figure {
-private:
-    int _hits;
-    bool _done;
-    int _direction[2] = { 0 };
-
-
-public:
-
-    Ball(string tile, int hits) : Figure(tile) {
-        _hits = hits;
-        _done = false;
-        int _direction[2] = { 0 };
-    }
-
-
-
-    void ball_movement(int* stop) {
-        // 0 up / 1 down
-
-        // 0 left / 1 right
-
-
-        if (_direction[0] == 1)
-            move_right(stop);
-        if (_direction[0] == 0)
-            move_left(stop);
-
-        if (x == 63)
-            _direction[0] = 0;
-        if (x == 0)
-            _direction[0] = 1;
-
-        if (_direction[1] == 1)
-            move_down(stop);
-        if (_direction[1] == 0)
-            move_up(stop);
-
-        if (y == 43)
-            _direction[1] = 0;
-        if (y == 0)
-            _direction[1] = 1;
-
-    }
-
-    void hit() {
-        _hits -= 1;
-        if (_hits == 0)
-            _done = true;
-    }
-
-    bool is_done() {
-        return _done;
-    }
-};
-
-class Monster : public Figure {
-private:
-    int _health;
-    bool _dead;
-
-
-public:
-
-
-    Monster(string tile) : Figure(tile) {
-        _dead = false;
-        _health = 100;
-    }
-    bool is_dead() {
-        return _dead;
-    }
-
-    void randmove(int* stop) {
-        int direction = rand() % 4;
-        if (direction == 0)
-            move_up(stop);
-        if (direction == 1)
-            move_down(stop);
-        if (direction == 2)
-            move_left(stop);
-        if (direction == 3)
-            move_right(stop);
-    }
-    void draw_figure() {
-        Figure::draw_figure();
-        draw_line(x * 16, y * 16 - 3, x * 16 + (16.0 / 100) * _health, y * 16 - 3, 255, 0);
-        draw_line(x * 16, y * 16 - 4, x * 16 + (16.0 / 100) * _health, y * 16 - 4, 255, 0);
-    }
-
-    void hit() {
-        _health -= 50;
-        if (_health == 0) {
-            _dead = true;
+// Spielt eine Aufnahme ohne Fenster ab und prueft den Zustandshash jedes Ticks
+int replay_headless(const string& file) {
+    mcigraph::InputReplayer replayer(file);
+    unique_ptr<Game> game(new Game(replayer.seed()));
+    auto start = chrono::steady_clock::now();
+    while (!replayer.done() && !game->finished()) {
+        mcigraph::InputFrame frame = replayer.next();
+        TickInput input = { frame.held, frame.pressed };
+        game->tick(input);
+        if (frame.hash != game->state_hash()) {
+            printf("Replay diverged at frame %zu\n", replayer.position() - 1);
+            return 1;
         }
-
-    }
-    void endgame() {
-        _health = 0;
-    }
-
-};
-
-class Gun : public Figure {
-private:
-    int _range;
-public:
-    Gun(int x1, int y1, string tile) : Figure(x1, x1, tile) {
-        _range = 5;
-    }
-
-    void range() {
-        _range += 2;
-    }
-
-    int get_range() {
-        return _range;
-    }
-
-
-};
-
-class Object : public Figure {
-private:
-    bool _collectable;
-    bool _range;
-    bool _time;
-
-
-public:
-
-    Object(string tile, bool collectable, bool range, bool time) : Figure(tile) {
-        _collectable = collectable;
-        _range = range;
-        _time = time;
-    }
-
-    bool is_collectable() {
-        return _collectable;
     }
-
-    bool range() {
-        return _range;
-    }
-    bool clock() {
-        return _time;
-    }
-
-    void draw_figure() {
-        Figure::draw_figure();
-    }
-};
-
-
-
-
-bool are_colliding(Figure* f1, Figure* f2) {
-    bool colliding = false;
-    if (f1->x == f2->x && f1->y == f2->y)
-        colliding = true;
-    return colliding;
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("Replayed %zu frames in %.3f s (%.0f ticks/s)\n", replayer.position(), elapsed, replayer.position() / elapsed);
+    return 0;
 }
 
-
-void generate_mapyx(int y1, int y2, int x1, int x2, int type, int randomizer, int* map) {
-    for (int y = y1; y < y2; y++) {
-        for (int x = x1; x < x2; x++) {
-            if (rand() % randomizer == 0)
-                map[y * 64 + x] = type;
+// Prueft Aufnahme und Wiedergabe: zeichnet bis zu frames Bilder mit
+// Zufallstasten ueber einen versteckten Kontext auf und spielt die Datei dann
+// ohne Fenster ab. Die Aufnahme muss die gedrueckten Tasten enthalten (sonst
+// fehlen beim Abspielen alle Schuesse) und jeder Zustandshash muss passen.
+int check_replay(const string& file, long frames, unsigned int seed) {
+    {
+        mcigraph::Context context("MCI Graph", 1024, 768, true);
+        mcigraph::set_current(context);
+        start_recording(file, seed);
+        unique_ptr<Game> game(new Game(seed));
+        mt19937 bot(seed);
+        const SDL_Scancode keys[] = { KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN, KEY_SPACE };
+        for (long t = 0; t < frames && !game->finished(); t++) {
+            if (bot() % 4 == 0) { // Tastendruck ueber die Ereignisschlange wie vom Fenster
+                SDL_Event e = {};
+                e.type = SDL_KEYDOWN;
+                e.key.windowID = SDL_GetWindowID(context.win);
+                e.key.keysym.scancode = keys[bot() % 5];
+                SDL_PushEvent(&e);
+            }
+            game->tick(read_input());
+            set_state_hash(game->state_hash());
+            present();
         }
-    }
-}
+    } // schliesst die Aufnahme
 
-void generate_mapx(int y, int x1, int x2, int type, int randomizer, int* map) {
-    for (int x = x1; x < x2; x++) {
-        if (rand() % randomizer == 0)
-            map[y * 64 + x] = type;
+    mcigraph::InputReplayer recorded(file);
+    size_t presses = 0;
+    while (!recorded.done()) {
+        if (recorded.next().pressed != 0)
+            presses++;
     }
-
+    if (presses == 0) {
+        printf("Recording %s has no key presses\n", file.c_str());
+        return 1;
+    }
+    printf("Recorded %zu frames, %zu with key presses\n", recorded.size(), presses);
+    return replay_headless(file);
 }
 
-void draw_map(int* map) {
-    for (int y = 0; y < 48; y++) {
-        for (int x = 0; x < 64; x++) {
-            if (map[y * 64 + x] == 0)
-                draw_image("grass.bmp", x * 16, y * 16);
-            else if (map[y * 64 + x] == 1)
-                draw_image("lake.bmp", x * 16, y * 16);
-            else if (map[y * 64 + x] == 2)
-                draw_image("gravel.bmp", x * 16, y * 16);
-            else if (map[y * 64 + x] == 3)
-                draw_image("wall.bmp", x * 16, y * 16);
-
+// Laesst n Instanzen parallel fuer ticks Schritte mit Zufallseingaben laufen
+int run_env(int n, long ticks, unsigned int seed) {
+    GameEnv env(n, seed);
+    RandomInput bot(seed);
+    vector<TickInput> actions(n);
+    auto start = chrono::steady_clock::now();
+    for (long t = 0; t < ticks; t++) {
+        for (int i = 0; i < n; i++)
+            actions[i] = bot(env.game(i));
+        env.step(actions);
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%d instances, %ld steps in %.3f s (%.0f instance ticks/s)\n", n, ticks, elapsed, n * ticks / elapsed);
+    return 0;
+}
+// Stresstest der Ballphysik: n Baelle auf der Endgame-Map. Mit ticks > 0
+// ohne Fenster fuer ticks Schritte, sonst gezeichnet, bis das Fenster zu ist.
+int run_ball_stress(int n, long ticks, unsigned int seed) {
+    unique_ptr<Game> game(new Game(seed));
+    unsigned int cores = thread::hardware_concurrency();
+    mcigraph::JobSystem jobs(cores > 1 ? cores - 1 : 0);
+    EntityStore balls;
+    Rng rng(seed, STREAM_SPAWN);
+    for (int i = 0; i < n; i++)
+        balls.spawn(i % 2 == 0 ? SPRITE_BALL1 : SPRITE_BALL2, 1, 0, rng);
+    auto start = chrono::steady_clock::now();
+    long t = 0;
+    for (; ticks > 0 ? t < ticks : running(); t++) {
+        move_bouncing(balls, game->map_3.collision, &jobs);
+        if (ticks == 0) {
+            draw_map(game->map_3);
+            draw_entities(balls);
+            present();
         }
     }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%d balls, %ld ticks in %.3f s (%.0f ticks/s)\n", n, t, elapsed, t / elapsed);
+    return 0;
 }
 
 
-
-
-
-
 int main(int argc, char* argv[]) {
-    int time_delay = 0;
-    int clock = 25;
-    int amount_monsters = 0;
-    int amount_balls = 0;
-    int monster_kill = 0;
-    int runindex = 0;
-    bool endofgame = false;
-    bool lost = false;
-
-
-
-
-
-    srand(time(0));
-    set_delay(100);
-    Player c1(32, 24, "char1.bmp");
-    Gun g1(32, 24, "gun.bmp");
-    vector<Monster> monsters;
-    vector<Object> objects;
-    vector<Ball> balls;
-
-    int map[64 * 48] = { 0 };
-    int map_2[64 * 48] = { 0 };
-    int map_3[64 * 48] = { 0 };
-
-    int stop[64 * 48] = { 0 };
-    int stop_2[64 * 48] = { 0 };
-    int stop_3[64 * 48] = { 0 };
-    generate_mapyx(0, 48, 0, 64, 1, 300, map); // Lake (kleine Pftzen)
-    generate_mapyx(30, 40, 10, 30, 2, 1, map); // Gravel
-    generate_mapx(15, 3, 50, 3, 1, map); // Wall
-    generate_mapyx(0, 48, 0, 64, 3, 1, map_3); // Hintergrund Wall
-    generate_mapyx(44, 48, 0, 64, 2, 1, map_3); // Gravel als Boden
-
-
-
-    for (int y = 0; y < 48; y++) { // Wall and Lake nicht begehbar
-        for (int x = 0; x < 64; x++) {
-            if (map[y * 64 + x] == 3 || map[y * 64 + x] == 1)
-                stop[y * 64 + x] = 1;
-        }
-    }
-
-
-
-    while (running()) {
-        while (monster_kill < 10) { // erste Map luft so lange, bis 10 Monster abgechossen wurden
-
-            draw_map(map);
-            c1.check_movement(KEY_A, KEY_D, KEY_W, KEY_S, stop);
-
-
-            if (rand() % 5 == 0 && amount_monsters < 20) { // 20 Monster erstellen
-                monsters.push_back(Monster("monster.bmp"));
-                amount_monsters++;
-            }
-
-
-            for (int i = 0; i < monsters.size(); i++) {  // Lschen von Monstern
-                if (monsters[i].is_dead() == true) {
-                    monsters.erase(monsters.begin() + i);
-                    monster_kill++;
-                }
-            }
-
-            for (auto& monster : monsters) { // Monster zeichnen
-                monster.randmove(stop); //Monster bewegen sich unwillkrlich
-                monster.draw_figure();
-            }
-
-            if (was_pressed(KEY_LEFT)) {
-                if (time_delay > clock) { // Verzgerung, damit man nicht urchgehend schieen kann
-                    g1.x = c1.x;
-                    g1.y = c1.y;
-                    int range = g1.get_range(); // holt sich die Reichweite des Schusses
-                    int z = 0;
-                    while (z < range) {
-                        g1.move_left(stop);
-                        g1.draw_figure();
-                        z++;
-                        for (auto& monster : monsters) {
-                            if (are_colliding(&g1, &monster)) {// Treffer
-                                monster.hit();
-                            }
-                        }
-                    }
-                    time_delay = 0;
-                }
-
-            }
-
-            if (was_pressed(KEY_RIGHT)) {
-                if (time_delay > clock) {
-                    g1.x = c1.x;
-                    g1.y = c1.y;
-                    int range = g1.get_range();
-                    int z = 0;
-                    while (z < range) {
-                        g1.move_right(stop);
-                        g1.draw_figure();
-                        z++;
-                        for (auto& monster : monsters) {
-                            if (are_colliding(&g1, &monster)) {// Treffer
-                                monster.hit();
-                            }
-                        }
-                    }
-                    time_delay = 0;
-                }
-
-            }
-
-
-            if (was_pressed(KEY_UP)) {
-                if (time_delay > clock) {
-                    g1.x = c1.x;
-                    g1.y = c1.y;
-                    int range = g1.get_range();
-                    int z = 0;
-                    while (z < range) {
-                        g1.move_up(stop);
-                        g1.draw_figure();
-                        z++;
-                        for (auto& monster : monsters) {
-                            if (are_colliding(&g1, &monster)) {// Treffer
-                                monster.hit();
-                            }
-                        }
-                    }
-                    time_delay = 0;
-                }
-
-            }
-            if (was_pressed(KEY_DOWN)) {
-                if (time_delay > clock) {
-                    g1.x = c1.x;
-                    g1.y = c1.y;
-                    int range = g1.get_range();
-                    int z = 0;
-                    while (z < range) {
-                        g1.move_down(stop);
-                        g1.draw_figure();
-                        z++;
-                        for (auto& monster : monsters) {
-                            if (are_colliding(&g1, &monster)) {// Treffer
-                                monster.hit();
-                            }
-                        }
-                    }
-                    time_delay = 0;
-                }
-
-            }
-
-
-
-            if (rand() % 55 == 0) { // Objecte erstellen
-                objects.push_back(Object("fire.bmp", false, false, false));
-                objects.push_back(Object("gold.bmp", true, true, false));
-                objects.push_back(Object("clock.bmp", true, false, true));
-            }
-
-
-
-            for (auto monster : monsters) {
-                if (are_colliding(&c1, &monster)) {// Kollision mit Monster
-                    if (c1.damage() == true) {
-                        return 0;
-                    }
-                }
-            }
-
-            for (int i = 0; i < objects.size(); i++) { // Goldbarren fr mehr Reichweite
-                if (are_colliding(&c1, &objects[i]) && objects[i].is_collectable() == true && objects[i].range() == true) {
-                    objects.erase(objects.begin() + i);
-                    g1.range();
-                }
-            }
-            for (int i = 0; i < objects.size(); i++) { // Objekt fr weniger Verzgerung zwischen den Schssen
-                if (are_colliding(&c1, &objects[i]) && objects[i].is_collectable() == true && objects[i].clock() == true) {
-                    objects.erase(objects.begin() + i);
-                    clock -= 2;
-                }
-            }
-            for (int i = 0; i < objects.size(); i++) { // Feuerstellen die Schaden am Spieler ausrichten
-                if (are_colliding(&c1, &objects[i]) && objects[i].is_collectable() == false) {
-                    c1.damage();
-                }
-            }
-
-
-            for (auto object : objects) // Objekte zeichnen
-                object.draw_figure();
-
-            c1.draw_figure();
-
-            draw_line(0, 1, 5 * (clock - time_delay), 1, 255, 0, 0); //Balken fr time_delay 
-            draw_line(0, 2, 5 * (clock - time_delay), 2, 255, 0, 0);
-            draw_line(0, 3, 5 * (clock - time_delay), 3, 255, 0, 0);
-            draw_line(0, 4, 5 * (clock - time_delay), 4, 255, 0, 0);
-
-            time_delay++;
-            present();
-        }
-
-
-        while (runindex < 1) { //Zwischenmap
-            objects.clear(); // Lsche den gesamten Objectektor
-            objects.push_back(Object("door.bmp", false, false, false)); // Erstellung einer Tr, die irgendwo am Spielfeld erscheint
-            runindex++;
-
-        }
-
-
-
-        while (runindex < 2 && are_colliding(&c1, &objects[0]) == false) { // diese Map mit der Tr wird angezeigt, bis der Spieler in die Tr eintritt
-            draw_map(map_2);
-            c1.check_movement(KEY_A, KEY_D, KEY_W, KEY_S, stop_2);
-            objects[0].draw_figure();
-            c1.draw_figure();
-            present();
-        }
-
-
-
-        while (endofgame == false && lost == false) { // Nach dem Eintritt in die Tr erscheint eine neue Map und ein neues Spiel
-            while (runindex < 2) {
-
-                monsters.clear(); // alle Monster entfernen
-                c1.x = 0;
-                c1.y = 43;
-                c1.endgame(0); // Charakter hat nun nur mehr ein Leben
-                time_delay = 0;
-                runindex++;
-
-            }
-
-
-
-            if (amount_balls < 5) { // Blle erstellen
-                balls.push_back(Ball("ball1.bmp", 2)); // dieser Ball muss zweimal getroffen werden
-                balls.push_back(Ball("ball2.bmp", 1)); // dieser Ball muss nur einmal getroffen werden
-                amount_balls++;
-            }
-  
-
-            draw_map(map_3);
-            c1.check_movement_endgame(KEY_LEFT, KEY_RIGHT, stop_3); // nur mehr rechts links mglich und ab jetzt mit den Pfeiltasten
-            c1.draw_figure();
-
-
-            if (was_pressed(KEY_SPACE)) { // mit der Leertaste wird ein Schuss nach oben abgegeben
-                if (time_delay > clock / 2) {
-                    g1.x = c1.x;
-                    g1.y = c1.y;
-                    int z = 0;
-                    while (z < 44) {
-                        g1.move_up(stop_3);
-                        g1.draw_figure();
-                        z++;
-                        for (auto& ball : balls) {
-                            if (are_colliding(&g1, &ball)) {// Treffer
-                                ball.hit();
-                            }
-                        }
-                    }
-                    time_delay = 0;
-                }
-
-            }
-
-            for (int i = 0; i < balls.size(); i++) {  // Lschen von Bllen
-                if (balls[i].is_done() == true) {
-                    balls.erase(balls.begin() + i);
-                }
-            }
-
-            for (auto& ball : balls) { // Blle zeichnen
-                if (time_delay % 2 == 0) {
-                    ball.ball_movement(stop_3);
-                }
-                ball.draw_figure();
-            }
-
-            for (auto& ball : balls) {
-                if (are_colliding(&c1, &ball)) {// Charakter wird vom Ball getroffen
-                    lost = true;
-                    return 0;
-                }
-            }
-
-            if (balls.size() == 0) { // alle Blle sind abgeschossen
-                endofgame = true;
-                return 0;
-            }
-
-
-            time_delay++;
-            present();
-
-        }
-
+    // --record <datei>  zeichnet Seed und Eingaben auf
+    // --replay <datei>  spielt sie so schnell wie moeglich ab
+    // --ticks <n>       laesst das Spiel ohne Fenster n Ticks mit Zufallseingaben laufen
+    // --ticks <n> --replay <datei> spielt die Aufnahme ohne Fenster ab
+    // --ticks <n> --env <k> laesst k Instanzen parallel n Ticks laufen
+    // --seed <n>        Seed statt der aktuellen Zeit
+    // --export-level <datei> schreibt die erste generierte Map als Leveldatei
+    // --level <datei>   spielt mit einer Leveldatei als erster Map
+    // --ball-stress <n> n Baelle auf der Endgame-Map, mit --ticks ohne Fenster
+    // --check-replay <datei> nimmt --ticks Bilder (Standard 600) auf und spielt sie zur Kontrolle ab
+    string record_file, replay_file, export_file, level_file, check_file;
+    long ticks = 0;
+    int env_count = 0;
+    int stress_balls = 0;
+    unsigned int seed = time(0);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if (arg == "--record")
+            record_file = argv[i + 1];
+        else if (arg == "--replay")
+            replay_file = argv[i + 1];
+        else if (arg == "--ticks")
+            ticks = atol(argv[i + 1]);
+        else if (arg == "--env")
+            env_count = atoi(argv[i + 1]);
+        else if (arg == "--seed")
+            seed = strtoul(argv[i + 1], NULL, 10);
+        else if (arg == "--export-level")
+            export_file = argv[i + 1];
+        else if (arg == "--level")
+            level_file = argv[i + 1];
+        else if (arg == "--ball-stress")
+            stress_balls = atoi(argv[i + 1]);
+        else if (arg == "--check-replay")
+            check_file = argv[i + 1];
+    }
+
+    if (export_file.size() > 0) { // Konverter: Ausgabe des Generators als Leveldatei
+        unique_ptr<Game> generated(new Game(seed));
+        write_level(export_file, generated->map, vector<LevelSpawn>());
+        printf("Wrote level %s (seed %u)\n", export_file.c_str(), seed);
+        return 0;
+    }
+
+    if (check_file.size() > 0)
+        return check_replay(check_file, ticks > 0 ? ticks : 600, seed);
+
+    if (stress_balls > 0)
+        return run_ball_stress(stress_balls, ticks, seed);
+
+    if (ticks > 0) {
+        if (replay_file.size() > 0)
+            return replay_headless(replay_file);
+        if (env_count > 0)
+            return run_env(env_count, ticks, seed);
+        double rate = run_ticks(ticks, seed, RandomInput(seed));
+        printf("%ld ticks, average %.0f ticks/s\n", ticks, rate);
+        return 0;
+    }
+
+    if (record_file.size() > 0)
+        start_recording(record_file, seed);
+    set_delay(1000 / FRAMES_PER_SECOND);
+    if (replay_file.size() > 0)
+        seed = start_replay(replay_file);
+
+    unsigned int cores = thread::hardware_concurrency();
+    mcigraph::JobSystem jobs(cores > 1 ? cores - 1 : 0);
+    unique_ptr<Game> game(new Game(seed));
+    game->jobs = &jobs;
+    unique_ptr<LevelFile> level;
+    if (level_file.size() > 0) {
+        level.reset(new LevelFile(level_file));
+        game->use_level(*level);
+    }
+
+    while (running() && !game->finished()) {
+        game->tick(read_input());
+        game->draw();
+        set_state_hash(game->state_hash());
         present();
-
-
     }
 
-    present();
-
 
     return 0;
 
@@ -622,4 +231,4 @@ int main(int argc, char* argv[]) {
 
 
 // Compile (Linux and MacOS):
-// g++ -std=c++11 -lpthread mandelbrot.cpp -I/usr/include/SDL2 -D_REENTRANT -L/usr/lib -pthread -lSDL2
+// g++ -std=c++11 -lpthread main.cpp -I/usr/include/SDL2 -D_REENTRANT -L/usr/lib -pthread -lSDL2
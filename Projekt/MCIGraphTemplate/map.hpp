@@ -0,0 +1,253 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "mcigraph.hpp"
+#include "collision.hpp"
+#include "mcirandom.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+// Kartenfunktionen, die von main.cpp und bench.cpp gemeinsam benutzt werden,
+// erzeugt werden die Karten in mapgen.hpp.
+// Eine Karte ist eine TileMap mit drei Ebenen: Gelaende (Tile, ein Byte pro
+// Kachel), Verzierungen (ebenfalls Tile, TILE_NONE wenn leer) und die
+// Begehbarkeit als CollisionGrid. Die Spielkarten sind 64 x 48 Kacheln gross.
+
+// Zufallszahlen gehoeren zur jeweiligen Spielinstanz statt zum globalen rand(),
+// damit mehrere Spiele unabhaengig voneinander laufen koennen. Jedes Subsystem
+// bekommt einen eigenen Strom (RandomStream).
+typedef mcigraph::Pcg32 Rng;
+
+enum RandomStream {
+    STREAM_MAP,   // Kartengenerator
+    STREAM_SPAWN, // Spawnen und Platzieren von Entitaeten
+    STREAM_AI     // Bewegungen der Monster
+};
+
+// Kachelarten, der Wert ist auch der Kanal-Wert in env.hpp
+enum Tile : uint8_t {
+    TILE_GRASS,
+    TILE_LAKE,
+    TILE_GRAVEL,
+    TILE_WALL,
+    TILE_COUNT,
+    TILE_NONE = 0xFF // leere Verzierung
+};
+
+const char* const TILE_FILES[TILE_COUNT] = { "grass.bmp", "lake.bmp", "gravel.bmp", "wall.bmp" };
+
+// Eine Zeile einer Ebene, als for (uint8_t tile : map.row(y))
+struct TileRow {
+    const uint8_t* first;
+    const uint8_t* last;
+
+    const uint8_t* begin() const {
+        return first;
+    }
+    const uint8_t* end() const {
+        return last;
+    }
+};
+
+// Speicher mit fester Groesse, Breite und Hoehe sind Konstanten, damit y * W
+// beim Indizieren zu einer Verschiebung wird
+template <int W, int H>
+class FixedTileStorage {
+protected:
+    uint8_t _terrain[W * H];
+    uint8_t _decoration[W * H];
+
+    FixedTileStorage() {}
+
+    uint8_t* terrain_layer() {
+        return _terrain;
+    }
+    const uint8_t* terrain_layer() const {
+        return _terrain;
+    }
+    uint8_t* decoration_layer() {
+        return _decoration;
+    }
+    const uint8_t* decoration_layer() const {
+        return _decoration;
+    }
+
+public:
+    int width() const {
+        return W;
+    }
+    int height() const {
+        return H;
+    }
+};
+
+// Speicher mit zur Laufzeit festgelegter Groesse
+class DynamicTileStorage {
+private:
+    int _width, _height;
+    std::vector<uint8_t> _terrain;
+    std::vector<uint8_t> _decoration;
+
+protected:
+    DynamicTileStorage(int width, int height)
+        : _width(width), _height(height), _terrain(width * height), _decoration(width * height) {}
+
+    uint8_t* terrain_layer() {
+        return _terrain.data();
+    }
+    const uint8_t* terrain_layer() const {
+        return _terrain.data();
+    }
+    uint8_t* decoration_layer() {
+        return _decoration.data();
+    }
+    const uint8_t* decoration_layer() const {
+        return _decoration.data();
+    }
+
+public:
+    int width() const {
+        return _width;
+    }
+    int height() const {
+        return _height;
+    }
+};
+
+// Speicher in fremdem Besitz, z.B. in einer gemappten Leveldatei (level.hpp)
+class MappedTileStorage {
+private:
+    int _width, _height;
+    uint8_t* _terrain;
+    uint8_t* _decoration;
+
+protected:
+    uint8_t* terrain_layer() {
+        return _terrain;
+    }
+    const uint8_t* terrain_layer() const {
+        return _terrain;
+    }
+    uint8_t* decoration_layer() {
+        return _decoration;
+    }
+    const uint8_t* decoration_layer() const {
+        return _decoration;
+    }
+
+public:
+    MappedTileStorage(int width, int height, uint8_t* terrain, uint8_t* decoration)
+        : _width(width), _height(height), _terrain(terrain), _decoration(decoration) {}
+
+    int width() const {
+        return _width;
+    }
+    int height() const {
+        return _height;
+    }
+};
+
+template <typename Storage>
+class BasicTileMap : public Storage {
+public:
+    CollisionGrid collision; // anfangs alles begehbar
+
+    BasicTileMap() : Storage(), collision(this->width(), this->height()) {
+        clear();
+    }
+    BasicTileMap(int width, int height) : Storage(width, height), collision(width, height) {
+        clear();
+    }
+    // Uebernimmt vorhandene Ebenen unveraendert
+    BasicTileMap(const Storage& storage, const CollisionGrid& grid) : Storage(storage), collision(grid) {}
+
+    int index(int x, int y) const {
+        return y * this->width() + x;
+    }
+
+    Tile terrain(int x, int y) const {
+        return static_cast<Tile>(this->terrain_layer()[index(x, y)]);
+    }
+    void set_terrain(int x, int y, Tile tile) {
+        this->terrain_layer()[index(x, y)] = tile;
+    }
+    Tile decoration(int x, int y) const {
+        return static_cast<Tile>(this->decoration_layer()[index(x, y)]);
+    }
+    void set_decoration(int x, int y, Tile tile) {
+        this->decoration_layer()[index(x, y)] = tile;
+    }
+
+    // Zusammenhaengende Gelaende-Bytes, Zeile fuer Zeile
+    const uint8_t* terrain_data() const {
+        return this->terrain_layer();
+    }
+    const uint8_t* decoration_data() const {
+        return this->decoration_layer();
+    }
+
+    // Kopiert alle Ebenen einer gleich grossen Karte mit anderem Speicher
+    template <typename OtherStorage>
+    void copy_from(const BasicTileMap<OtherStorage>& other) {
+        int count = this->width() * this->height();
+        std::copy(other.terrain_data(), other.terrain_data() + count, this->terrain_layer());
+        std::copy(other.decoration_data(), other.decoration_data() + count, this->decoration_layer());
+        collision.copy_from(other.collision);
+    }
+
+    TileRow row(int y) const {
+        TileRow r = { this->terrain_layer() + index(0, y), this->terrain_layer() + index(0, y) + this->width() };
+        return r;
+    }
+    TileRow decoration_row(int y) const {
+        TileRow r = { this->decoration_layer() + index(0, y), this->decoration_layer() + index(0, y) + this->width() };
+        return r;
+    }
+
+    // Gras ohne Verzierungen
+    void clear() {
+        std::fill(this->terrain_layer(), this->terrain_layer() + this->width() * this->height(), static_cast<uint8_t>(TILE_GRASS));
+        std::fill(this->decoration_layer(), this->decoration_layer() + this->width() * this->height(), static_cast<uint8_t>(TILE_NONE));
+    }
+
+    // Markiert alle Kacheln mit dem Gelaende tile als nicht begehbar
+    void block(Tile tile) {
+        for (int y = 0; y < this->height(); y++) {
+            int x = 0;
+            for (uint8_t t : row(y)) {
+                if (t == tile)
+                    collision.set(x, y, true);
+                x++;
+            }
+        }
+    }
+};
+
+template <int W, int H>
+using TileMap = BasicTileMap<FixedTileStorage<W, H> >;
+
+typedef BasicTileMap<DynamicTileStorage> DynamicTileMap;
+typedef BasicTileMap<MappedTileStorage> MappedTileMap;
+
+typedef TileMap<64, 48> GameMap;
+
+template <typename Map>
+void draw_map(const Map& map) {
+    for (int y = 0; y < map.height(); y++) {
+        int x = 0;
+        for (uint8_t tile : map.row(y)) {
+            if (tile < TILE_COUNT)
+                draw_image(TILE_FILES[tile], x * 16, y * 16);
+            x++;
+        }
+        x = 0;
+        for (uint8_t tile : map.decoration_row(y)) {
+            if (tile < TILE_COUNT)
+                draw_image(TILE_FILES[tile], x * 16, y * 16);
+            x++;
+        }
+    }
+}
+
+#endif /* MAP_H */
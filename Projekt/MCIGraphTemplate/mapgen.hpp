@@ -0,0 +1,227 @@
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+#include "map.hpp"
+#include "workers.hpp"
+#include <stdint.h>
+#include <vector>
+
+// Prozeduraler Kartengenerator. Die Karte wird in Chunks (chunk_size x
+// chunk_size Kacheln) zerlegt, die unabhaengig voneinander und parallel
+// erzeugt werden. Jeder Chunk hat einen eigenen zaehlerbasierten Zufall,
+// dessen Schluessel nur aus dem Welt-Seed und den Chunk-Koordinaten entsteht:
+// Zufallswert i ist hash(Schluessel, i). Das Ergebnis haengt deshalb weder
+// von der Anzahl der Threads noch von der Reihenfolge der Chunks ab.
+
+// Mischfunktion von SplitMix64, auch als Hash fuer den Zufall und das Rauschen
+inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Zaehlerbasierter Zufall: kein Zustand ausser Schluessel und Zaehler, jeder
+// Wert ist direkt ueber at(i) erreichbar. Erfuellt die Anforderungen eines
+// Zufallsgenerators der Standardbibliothek.
+class CounterRng {
+private:
+    uint64_t _key;
+    uint64_t _counter;
+
+public:
+    typedef uint32_t result_type;
+
+    CounterRng(uint64_t seed, int chunk_x, int chunk_y, uint64_t stream = 0)
+        : _key(mix64(mix64(mix64(seed) ^ static_cast<uint32_t>(chunk_x)) ^ (static_cast<uint64_t>(static_cast<uint32_t>(chunk_y)) << 32) ^ stream)),
+          _counter(0) {}
+
+    uint32_t at(uint64_t counter) const {
+        return static_cast<uint32_t>(mix64(_key + counter * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    uint32_t operator()() {
+        return at(_counter++);
+    }
+
+    static uint32_t min() {
+        return 0;
+    }
+    static uint32_t max() {
+        return 0xFFFFFFFF;
+    }
+};
+
+// Zufallswert in [0, 1) eines Gitterpunkts des Rauschens
+inline float lattice_value(uint64_t seed, int octave, int x, int y) {
+    uint64_t lattice = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    uint64_t h = mix64(seed ^ mix64(lattice + octave * 0x9E3779B97F4A7C15ULL));
+    return (h >> 40) / 16777216.0f;
+}
+
+inline int floor_int(float v) {
+    return v >= 0 ? static_cast<int>(v) : static_cast<int>(v) - 1;
+}
+
+inline float smooth(float t) { // weicher Uebergang zwischen den Gitterpunkten
+    return t * t * (3 - 2 * t);
+}
+
+// Wertrauschen im Bereich [0, 1) an der Stelle (x, y), mit octaves Oktaven.
+// Die Gitterwerte haengen nur vom Seed und der Gitterposition ab, damit das
+// Rauschen ueber Chunkgrenzen hinweg nahtlos ist.
+inline float value_noise(uint64_t seed, float x, float y, int octaves) {
+    float sum = 0, amplitude = 0.5f, total = 0;
+    for (int octave = 0; octave < octaves; octave++) {
+        int x0 = floor_int(x), y0 = floor_int(y);
+        float fx = smooth(x - x0), fy = smooth(y - y0);
+        float top = lattice_value(seed, octave, x0, y0) + (lattice_value(seed, octave, x0 + 1, y0) - lattice_value(seed, octave, x0, y0)) * fx;
+        float bottom = lattice_value(seed, octave, x0, y0 + 1) + (lattice_value(seed, octave, x0 + 1, y0 + 1) - lattice_value(seed, octave, x0, y0 + 1)) * fx;
+        sum += (top + (bottom - top) * fy) * amplitude;
+        total += amplitude;
+        amplitude *= 0.5f;
+        x *= 2;
+        y *= 2;
+    }
+    return sum / total;
+}
+
+// value_noise fuer alle Kacheln (x, y) mit x1 <= x < x2, y1 <= y < y2 an der
+// Stelle (x * scale, y * scale), zeilenweise nach out. Die Gitterwerte jeder
+// Oktave werden nur einmal pro Rechteck berechnet statt viermal pro Kachel.
+inline void fill_noise(uint64_t seed, int x1, int y1, int x2, int y2, float scale, int octaves,
+                       std::vector<float>& out, std::vector<float>& lattice) {
+    int w = x2 - x1, h = y2 - y1;
+    out.assign(static_cast<size_t>(w) * h, 0.0f);
+    float amplitude = 0.5f, total = 0, factor = 1;
+    for (int octave = 0; octave < octaves; octave++) {
+        int lx = floor_int(x1 * scale * factor), ly = floor_int(y1 * scale * factor);
+        int lw = floor_int((x2 - 1) * scale * factor) - lx + 2;
+        int lh = floor_int((y2 - 1) * scale * factor) - ly + 2;
+        lattice.resize(static_cast<size_t>(lw) * lh);
+        for (int j = 0; j < lh; j++) {
+            for (int i = 0; i < lw; i++)
+                lattice[j * lw + i] = lattice_value(seed, octave, lx + i, ly + j);
+        }
+        for (int y = y1; y < y2; y++) {
+            float py = y * scale * factor;
+            int y0 = floor_int(py);
+            float fy = smooth(py - y0);
+            const float* row = &lattice[(y0 - ly) * lw];
+            float* dst = &out[static_cast<size_t>(y - y1) * w];
+            for (int x = x1; x < x2; x++) {
+                float px = x * scale * factor;
+                int x0 = floor_int(px);
+                float fx = smooth(px - x0);
+                const float* c = row + (x0 - lx);
+                float top = c[0] + (c[1] - c[0]) * fx;
+                float bottom = c[lw] + (c[lw + 1] - c[lw]) * fx;
+                dst[x - x1] += (top + (bottom - top) * fy) * amplitude;
+            }
+        }
+        total += amplitude;
+        amplitude *= 0.5f;
+        factor *= 2;
+    }
+    for (float& v : out)
+        v /= total;
+}
+
+class MapGenerator {
+private:
+    // Eine Regel setzt im Rechteck (x1, y1)-(x2, y2), rechter und unterer
+    // Rand ausgeschlossen, Kacheln auf tile
+    struct Rule {
+        bool noise;     // false: mit Wahrscheinlichkeit 1 / randomizer, true: wo das Rauschen > threshold
+        Tile tile;
+        int x1, y1, x2, y2;
+        int randomizer;
+        float scale, threshold;
+        int octaves;
+    };
+
+    uint64_t _seed;
+    int _chunk_size;
+    std::vector<Rule> _rules;
+
+    template <typename Map>
+    void generate_chunk(Map& map, int chunk_x, int chunk_y) const {
+        int cx1 = chunk_x * _chunk_size, cy1 = chunk_y * _chunk_size;
+        int cx2 = cx1 + _chunk_size < map.width() ? cx1 + _chunk_size : map.width();
+        int cy2 = cy1 + _chunk_size < map.height() ? cy1 + _chunk_size : map.height();
+        CounterRng rng(_seed, chunk_x, chunk_y);
+        std::vector<float> noise, lattice;
+        for (size_t r = 0; r < _rules.size(); r++) {
+            const Rule& rule = _rules[r];
+            int x1 = rule.x1 > cx1 ? rule.x1 : cx1, x2 = rule.x2 < cx2 ? rule.x2 : cx2;
+            int y1 = rule.y1 > cy1 ? rule.y1 : cy1, y2 = rule.y2 < cy2 ? rule.y2 : cy2;
+            if (x1 >= x2 || y1 >= y2)
+                continue;
+            if (rule.noise) {
+                fill_noise(_seed + r, x1, y1, x2, y2, rule.scale, rule.octaves, noise, lattice);
+                for (int y = y1; y < y2; y++) {
+                    for (int x = x1; x < x2; x++) {
+                        if (noise[(y - y1) * (x2 - x1) + (x - x1)] > rule.threshold)
+                            map.set_terrain(x, y, rule.tile);
+                    }
+                }
+                continue;
+            }
+            for (int y = y1; y < y2; y++) {
+                for (int x = x1; x < x2; x++) { // Zaehler: Regel in den oberen Bits, Kachel im Chunk in den unteren
+                    uint64_t counter = (static_cast<uint64_t>(r) << 32) | static_cast<uint32_t>((y - cy1) * _chunk_size + (x - cx1));
+                    if (rule.randomizer <= 1 || rng.at(counter) % rule.randomizer == 0)
+                        map.set_terrain(x, y, rule.tile);
+                }
+            }
+        }
+    }
+
+public:
+    MapGenerator(uint64_t seed, int chunk_size = 64) : _seed(seed), _chunk_size(chunk_size) {}
+
+    // Jede Kachel im Rechteck wird mit Wahrscheinlichkeit 1 / randomizer zu tile
+    MapGenerator& random(int x1, int y1, int x2, int y2, Tile tile, int randomizer) {
+        Rule rule = { false, tile, x1, y1, x2, y2, randomizer, 0, 0, 0 };
+        _rules.push_back(rule);
+        return *this;
+    }
+
+    // Jede Kachel im Rechteck wird zu tile, wo value_noise(x * scale, y * scale) > threshold ist
+    MapGenerator& noise(int x1, int y1, int x2, int y2, Tile tile, float scale, float threshold, int octaves = 4) {
+        Rule rule = { true, tile, x1, y1, x2, y2, 0, scale, threshold, octaves };
+        _rules.push_back(rule);
+        return *this;
+    }
+
+    // Wendet alle Regeln der Reihe nach an. Mit pool werden die Chunks auf
+    // dessen Threads verteilt, sonst nacheinander erzeugt.
+    template <typename Map>
+    void generate(Map& map, WorkerPool* pool = NULL) const {
+        int columns = (map.width() + _chunk_size - 1) / _chunk_size;
+        int rows = (map.height() + _chunk_size - 1) / _chunk_size;
+        if (pool == NULL) {
+            for (int i = 0; i < columns * rows; i++)
+                generate_chunk(map, i % columns, i / columns);
+        }
+        else {
+            pool->run(columns * rows, [&](int i) { generate_chunk(map, i % columns, i / columns); });
+        }
+    }
+};
+
+// Erzeugt die erste Karte (map) und die Endgame-Karte (map_3), die Zwischenkarte bleibt leeres Gras
+template <typename Map>
+void generate_maps(Map& map, Map& map_3, Rng& rng) {
+    MapGenerator first(rng());
+    first.random(0, 0, 64, 48, TILE_LAKE, 300) // Lake (kleine Pfuetzen)
+        .random(10, 30, 30, 40, TILE_GRAVEL, 1) // Gravel
+        .random(3, 15, 50, 16, TILE_WALL, 1); // Wall
+    first.generate(map);
+
+    MapGenerator endgame(rng());
+    endgame.random(0, 0, 64, 48, TILE_WALL, 1) // Hintergrund Wall
+        .random(0, 44, 64, 48, TILE_GRAVEL, 1); // Gravel als Boden
+    endgame.generate(map_3);
+}
+
+#endif /* MAPGEN_H */
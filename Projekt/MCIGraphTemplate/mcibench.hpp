@@ -0,0 +1,123 @@
+#ifndef MCIBENCH_H
+#define MCIBENCH_H
+
+// Small microbenchmark harness used by bench.cpp. Every benchmark is run a
+// few times to warm up caches and the driver, then timed for a number of
+// repetitions. The per-operation times of the repetitions are summarized as
+// min / median / mean / standard deviation so that numbers from before and
+// after an optimization can be compared directly.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace mcigraph {
+
+// Result of one benchmark, all times are nanoseconds per operation
+struct BenchResult {
+  std::string name;
+  std::size_t ops;  // Operations per repetition
+  std::size_t reps; // Number of timed repetitions
+  double min, median, mean, stddev;
+};
+
+struct BenchOptions {
+  int warmup = 3; // Untimed repetitions before measuring
+  int reps = 15;  // Timed repetitions
+  std::string filter; // Only run benchmarks whose name contains this
+  bool csv = false;   // Print comma separated values instead of a table
+};
+
+class BenchRunner {
+private:
+  BenchOptions _options;
+  std::vector<BenchResult> _results;
+
+public:
+  BenchRunner(BenchOptions options) : _options{options} {
+    if (_options.csv)
+      std::printf("name,ops,reps,min_ns,median_ns,mean_ns,stddev_ns\n");
+    else
+      std::printf("%-32s %10s %12s %12s %12s %12s\n", "benchmark", "ops",
+                  "min ns/op", "median ns/op", "mean ns/op", "stddev");
+  }
+
+  /// Run fn (which performs ops operations) with warmup and repetitions.
+  /// setup is called before every repetition and is not timed.
+  template <typename Setup, typename Fn>
+  void run(const std::string &name, std::size_t ops, Setup setup, Fn fn) {
+    if (_options.filter.size() > 0 &&
+        name.find(_options.filter) == std::string::npos)
+      return;
+    for (int i = 0; i < _options.warmup; i++) {
+      setup();
+      fn();
+    }
+    std::vector<double> samples;
+    for (int i = 0; i < _options.reps; i++) {
+      setup();
+      auto start = std::chrono::steady_clock::now();
+      fn();
+      auto end = std::chrono::steady_clock::now();
+      double ns = std::chrono::duration<double, std::nano>(end - start).count();
+      samples.push_back(ns / ops);
+    }
+    report(summarize(name, ops, samples));
+  }
+
+  /// Same as above for benchmarks that need no setup
+  template <typename Fn> void run(const std::string &name, std::size_t ops, Fn fn) {
+    run(name, ops, [] {}, fn);
+  }
+
+  const std::vector<BenchResult> &results() const { return _results; }
+
+private:
+  static BenchResult summarize(const std::string &name, std::size_t ops,
+                               std::vector<double> samples) {
+    BenchResult r;
+    r.name = name;
+    r.ops = ops;
+    r.reps = samples.size();
+    std::sort(samples.begin(), samples.end());
+    r.min = samples.front();
+    std::size_t mid = samples.size() / 2;
+    r.median = samples.size() % 2 == 1
+                   ? samples[mid]
+                   : (samples[mid - 1] + samples[mid]) / 2.0;
+    double sum = 0;
+    for (auto s : samples)
+      sum += s;
+    r.mean = sum / samples.size();
+    double var = 0;
+    for (auto s : samples)
+      var += (s - r.mean) * (s - r.mean);
+    r.stddev = samples.size() > 1 ? std::sqrt(var / (samples.size() - 1)) : 0;
+    return r;
+  }
+
+  void report(const BenchResult &r) {
+    if (_options.csv)
+      std::printf("%s,%zu,%zu,%.2f,%.2f,%.2f,%.2f\n", r.name.c_str(), r.ops,
+                  r.reps, r.min, r.median, r.mean, r.stddev);
+    else
+      std::printf("%-32s %10zu %12.2f %12.2f %12.2f %12.2f\n", r.name.c_str(),
+                  r.ops, r.min, r.median, r.mean, r.stddev);
+    std::fflush(stdout);
+    _results.push_back(r);
+  }
+};
+
+/// Prevent the compiler from optimizing away a computed value
+template <typename T> inline void do_not_optimize(const T &value) {
+  static const T *volatile sink;
+  sink = &value;
+  (void)sink;
+}
+
+} // namespace mcigraph
+
+#endif /* MCIBENCH_H */
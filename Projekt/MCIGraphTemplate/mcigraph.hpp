@@ -5,8 +5,12 @@
 // This is done here for ease of use for educational purposes only!!
 
 #include <SDL.h>
+#include <algorithm>
 #include <cstdint> // For fixed width integer types
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
 
 #include <string>
 #include <thread>
@@ -24,16 +28,105 @@ struct MciGraphException {
   }
 };
 
+// 1-bit collision mask of a sprite. Pixel x of row y is bit x % 64 of word
+// x / 64 of that row, rows are padded with zero bits to whole 64-bit words.
+struct CollisionMask {
+  int width, height;
+  int words; // 64-bit words per row
+  std::vector<uint64_t> bits;
+
+  CollisionMask() : width(0), height(0), words(0) {}
+  CollisionMask(int w, int h, bool solid = false)
+      : width(w), height(h), words((w + 63) / 64), bits(words * h, 0) {
+    if (solid) {
+      for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+          set(x, y);
+    }
+  }
+
+  const uint64_t *row(int y) const { return &bits[y * words]; }
+  bool opaque(int x, int y) const {
+    return (row(y)[x / 64] >> (x % 64)) & 1;
+  }
+  void set(int x, int y) { bits[y * words + x / 64] |= 1ULL << (x % 64); }
+};
+
+// Builds the mask of a surface, every pixel that does not have the color
+// key is opaque
+inline CollisionMask make_collision_mask(SDL_Surface *surface, Uint32 key) {
+  CollisionMask mask(surface->w, surface->h);
+  bool locked = SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) == 0;
+  const SDL_PixelFormat *format = surface->format;
+  int bpp = format->BytesPerPixel;
+  key &= ~format->Amask;
+  for (int y = 0; y < surface->h; y++) {
+    const uint8_t *p =
+        static_cast<const uint8_t *>(surface->pixels) + y * surface->pitch;
+    for (int x = 0; x < surface->w; x++, p += bpp) {
+      Uint32 pixel = 0;
+      if (bpp == 1) {
+        pixel = p[0];
+      } else if (bpp == 2) {
+        Uint16 value;
+        std::memcpy(&value, p, 2);
+        pixel = value;
+      } else if (bpp == 3) {
+        pixel = SDL_BYTEORDER == SDL_BIG_ENDIAN
+                    ? (p[0] << 16) | (p[1] << 8) | p[2]
+                    : p[0] | (p[1] << 8) | (p[2] << 16);
+      } else {
+        std::memcpy(&pixel, p, 4);
+      }
+      if ((pixel & ~format->Amask) != key)
+        mask.set(x, y);
+    }
+  }
+  if (locked)
+    SDL_UnlockSurface(surface);
+  return mask;
+}
+
+// True if an opaque pixel of a drawn at (ax, ay) covers an opaque pixel of
+// b drawn at (bx, by). After the bounding box test the rows of the right
+// mask are shifted into the columns of the left one and ANDed word by word,
+// so sprites up to 64 pixels wide cost one shift and one AND per row.
+inline bool masks_overlap(const CollisionMask &a, int ax, int ay,
+                          const CollisionMask &b, int bx, int by) {
+  if (ax >= bx + b.width || bx >= ax + a.width || ay >= by + b.height ||
+      by >= ay + a.height)
+    return false;
+  if (bx < ax)
+    return masks_overlap(b, bx, by, a, ax, ay);
+  // Column c of a meets column c - dx of b
+  int dx = bx - ax, skip = dx / 64, shift = dx % 64;
+  int top = std::max(ay, by), bottom = std::min(ay + a.height, by + b.height);
+  for (int y = top; y < bottom; y++) {
+    const uint64_t *ra = a.row(y - ay), *rb = b.row(y - by);
+    for (int k = skip; k < a.words; k++) {
+      int kb = k - skip;
+      uint64_t shifted = kb < b.words ? rb[kb] << shift : 0;
+      if (shift != 0 && kb > 0 && kb - 1 < b.words)
+        shifted |= rb[kb - 1] >> (64 - shift);
+      if (ra[k] & shifted)
+        return true;
+    }
+  }
+  return false;
+}
+
 // The class TextureLoadCache allows to load images from files and
 // returns a texture for the given file name. More importantly, it
 // caches already loaded images. Warning: The cache does not delete
 // already loaded textures when memory runs out etc. (which should not
-// happen for our use case)
+// happen for our use case). Every loaded image also gets a collision mask
+// built from its magenta color key, see mask().
 class TextureLoadCache {
 private:
   // The map saving already used image names and their associated
   // textures
   std::unordered_map<std::string, SDL_Texture *> _cache;
+  std::unordered_map<std::string, CollisionMask> _masks;
   // Renderer used to create texture from image
   SDL_Renderer *_ren;
 
@@ -43,28 +136,21 @@ public:
   TextureLoadCache(SDL_Renderer *ren) : _ren{ren} {};
 
   // Destructor
-  ~TextureLoadCache() {
+  ~TextureLoadCache() { clear(); }
+
+  /// Destroy all cached textures. Must be called before the renderer
+  /// they were created with is destroyed.
+  void clear() {
     for (auto i : _cache) {
       SDL_DestroyTexture(i.second);
     }
+    _cache.clear();
   }
 
   SDL_Texture *load(std::string filename) {
     // If the file is not in cache: Load, make texture, save to cache and return
     if (_cache.count(filename) == 0) {
-      SDL_Surface *bmp = SDL_LoadBMP(filename.c_str());
-      // If loading fails (usually because of using a wrong file name,
-      // throw an exception naming the used base path where images
-      // should be put)
-      if (bmp == NULL) {
-        throw MciGraphException(
-            "Could not load image: " + std::string(SDL_GetError()) +
-            " Please put your images in the directory: " +
-            std::string(SDL_GetBasePath()));
-      }
-      // Set magenta pixels of the image as transparent
-      auto magenta = SDL_MapRGB(bmp->format, 0xFF, 0x00, 0xFF);
-      SDL_SetColorKey(bmp, SDL_TRUE, magenta);
+      SDL_Surface *bmp = load_surface(filename);
       // Create texture from loaded image
       SDL_Texture *tex = SDL_CreateTextureFromSurface(_ren, bmp);
       SDL_FreeSurface(bmp);
@@ -77,6 +163,38 @@ public:
     }
     return _cache[filename];
   }
+
+  /// Collision mask of an image, magenta pixels are transparent. Works
+  /// without a renderer, images that were not drawn yet are loaded only
+  /// for their mask.
+  const CollisionMask &mask(std::string filename) {
+    auto found = _masks.find(filename);
+    if (found != _masks.end())
+      return found->second;
+    SDL_FreeSurface(load_surface(filename));
+    return _masks[filename];
+  }
+
+private:
+  // Loads an image, sets magenta as its color key and builds its mask
+  SDL_Surface *load_surface(const std::string &filename) {
+    SDL_Surface *bmp = SDL_LoadBMP(filename.c_str());
+    // If loading fails (usually because of using a wrong file name,
+    // throw an exception naming the used base path where images
+    // should be put)
+    if (bmp == NULL) {
+      throw MciGraphException(
+          "Could not load image: " + std::string(SDL_GetError()) +
+          " Please put your images in the directory: " +
+          std::string(SDL_GetBasePath()));
+    }
+    // Set magenta pixels of the image as transparent
+    auto magenta = SDL_MapRGB(bmp->format, 0xFF, 0x00, 0xFF);
+    SDL_SetColorKey(bmp, SDL_TRUE, magenta);
+    if (_masks.count(filename) == 0)
+      _masks[filename] = make_collision_mask(bmp, magenta);
+    return bmp;
+  }
 };
 
 // Struct used to represent color values
@@ -84,12 +202,185 @@ struct Color {
   uint8_t red, green, blue;
 };
 
-class MciGraph {
+// Recording and replaying of keyboard input. While recording, MciGraph
+// takes a snapshot of the keys below once per frame (in present()) and all
+// calls of is_pressed/was_pressed during the next frame are answered from
+// that snapshot. The snapshots are written to a small binary file together
+// with the random seed of the game and a hash of the game state per frame.
+// Replaying feeds the same snapshots back and compares the state hashes so
+// that a diverging simulation is detected at the first differing frame.
+//
+// File layout (all values little endian):
+//   header: "MCIR" | uint32 version | uint64 seed
+//   frame:  uint32 held keys | uint32 pressed keys | uint64 state hash
+
+// Keys that are part of a snapshot. The position in this table is the bit
+// used for the key in InputFrame::held and InputFrame::pressed.
+const SDL_Scancode RECORDED_KEYS[] = {
+    SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT, SDL_SCANCODE_UP, SDL_SCANCODE_DOWN,
+    SDL_SCANCODE_1,    SDL_SCANCODE_2,     SDL_SCANCODE_3,  SDL_SCANCODE_4,
+    SDL_SCANCODE_5,    SDL_SCANCODE_6,     SDL_SCANCODE_7,  SDL_SCANCODE_8,
+    SDL_SCANCODE_9,    SDL_SCANCODE_0,     SDL_SCANCODE_W,  SDL_SCANCODE_A,
+    SDL_SCANCODE_S,    SDL_SCANCODE_D,     SDL_SCANCODE_SPACE};
+const int RECORDED_KEY_COUNT = sizeof(RECORDED_KEYS) / sizeof(RECORDED_KEYS[0]);
+
+/// Returns the bit of the given key in an InputFrame or 0 if the key is not
+/// recorded
+inline uint32_t recorded_key_bit(int key) {
+  for (int i = 0; i < RECORDED_KEY_COUNT; i++) {
+    if (RECORDED_KEYS[i] == key)
+      return 1u << i;
+  }
+  return 0;
+}
+
+// Input of one frame and the hash of the game state after that frame
+struct InputFrame {
+  uint32_t held;    // Keys held down (is_pressed)
+  uint32_t pressed; // Key presses not consumed yet (was_pressed)
+  uint64_t hash;    // State hash reported by the game, 0 if none
+};
+
+// FNV-1a, used by games to hash their state once per tick
+const uint64_t STATE_HASH_SEED = 14695981039346656037ULL;
+
+inline uint64_t hash_state(uint64_t h, int64_t value) {
+  for (int i = 0; i < 8; i++) {
+    h ^= static_cast<uint64_t>(value >> (i * 8)) & 0xFF;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+const uint32_t REPLAY_VERSION = 1;
+
+// Helpers writing and reading little endian values
+inline void put_le(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+inline uint64_t get_le(const uint8_t *in, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++)
+    value |= static_cast<uint64_t>(in[i]) << (i * 8);
+  return value;
+}
+
+// Writes frames to a replay file. Frames are buffered and flushed in
+// blocks so recording does not cost a system call per frame.
+class InputRecorder {
+private:
+  std::FILE *_file;
+  std::vector<uint8_t> _buffer;
+
+public:
+  InputRecorder(const std::string &filename, uint64_t seed) {
+    _file = std::fopen(filename.c_str(), "wb");
+    if (_file == NULL)
+      throw MciGraphException("Could not open replay file for writing: " +
+                              filename);
+    _buffer.insert(_buffer.end(), {'M', 'C', 'I', 'R'});
+    put_le(_buffer, REPLAY_VERSION, 4);
+    put_le(_buffer, seed, 8);
+  }
+
+  ~InputRecorder() {
+    flush();
+    std::fclose(_file);
+  }
+
+  void write(const InputFrame &frame) {
+    put_le(_buffer, frame.held, 4);
+    put_le(_buffer, frame.pressed, 4);
+    put_le(_buffer, frame.hash, 8);
+    if (_buffer.size() >= 4096)
+      flush();
+  }
+
+  void flush() {
+    if (_buffer.size() > 0)
+      std::fwrite(_buffer.data(), 1, _buffer.size(), _file);
+    std::fflush(_file);
+    _buffer.clear();
+  }
+
+private:
+  InputRecorder(const InputRecorder &);
+  InputRecorder &operator=(const InputRecorder &);
+};
+
+// Reads a complete replay file into memory and hands out its frames
+class InputReplayer {
+private:
+  uint64_t _seed;
+  std::vector<InputFrame> _frames;
+  std::size_t _next;
+
+public:
+  InputReplayer(const std::string &filename) : _seed{0}, _next{0} {
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (file == NULL)
+      throw MciGraphException("Could not open replay file: " + filename);
+    std::vector<uint8_t> data;
+    uint8_t block[4096];
+    std::size_t n;
+    while ((n = std::fread(block, 1, sizeof(block), file)) > 0)
+      data.insert(data.end(), block, block + n);
+    std::fclose(file);
+
+    if (data.size() < 16 || data[0] != 'M' || data[1] != 'C' ||
+        data[2] != 'I' || data[3] != 'R')
+      throw MciGraphException("Not a replay file: " + filename);
+    if (get_le(&data[4], 4) != REPLAY_VERSION)
+      throw MciGraphException("Unsupported replay version: " + filename);
+    _seed = get_le(&data[8], 8);
+    for (std::size_t pos = 16; pos + 16 <= data.size(); pos += 16) {
+      InputFrame frame;
+      frame.held = static_cast<uint32_t>(get_le(&data[pos], 4));
+      frame.pressed = static_cast<uint32_t>(get_le(&data[pos + 4], 4));
+      frame.hash = get_le(&data[pos + 8], 8);
+      _frames.push_back(frame);
+    }
+  }
+
+  uint64_t seed() const { return _seed; }
+  bool done() const { return _next >= _frames.size(); }
+  std::size_t position() const { return _next; }
+  std::size_t size() const { return _frames.size(); }
+
+  /// Returns the next frame, an empty frame after the end of the recording
+  InputFrame next() {
+    if (done())
+      return InputFrame{0, 0, 0};
+    return _frames[_next++];
+  }
+};
+
+class Context;
+inline Context *&current_context();
+
+// A Context owns a window (or an offscreen render target), its renderer,
+// texture cache and input state. Any number of contexts can exist at the
+// same time, e.g. several windows or offscreen contexts for tests. The free
+// functions at the end of this file draw to the current context, which is
+// the default context unless another one is selected with set_current().
+class Context {
 private:
-  std::thread _event_loop_thread;
   TextureLoadCache _texcache;
   Color _background;
   std::vector<bool> _keystate;
+  // Recording / replaying of input, see InputRecorder and InputReplayer
+  std::unique_ptr<InputRecorder> _recorder;
+  std::unique_ptr<InputReplayer> _replayer;
+  InputFrame _frame;  // Input snapshot answering is_pressed/was_pressed
+  uint32_t _unconsumed; // Presses of _frame not consumed by was_pressed yet
+  bool _latched;      // True while input is answered from _frame
+  std::size_t _frame_index;
+  bool _offscreen;    // Render into _screen instead of the window
+  SDL_Texture *_screen; // Default render target of offscreen contexts
+  std::vector<SDL_Texture *> _targets; // Render targets created by this context
+  Uint32 _window_id;
 
 public:
   bool running;
@@ -97,46 +388,60 @@ public:
   SDL_Renderer *ren;
   int delay;
 
-private:
-  // Constructor is private to prevent people from creating an
-  // instance of MciGraph directly. Access should be done by using
-  // get_instance following the singleton pattern. This will return a
-  // single instance of MCIGraph that is consistent for the whole
-  // program.
-  MciGraph() {
+  /// Create a context with a window of the given size. An offscreen context
+  /// uses a hidden window and renders into a texture whose pixels can be
+  /// read with read_pixels().
+  Context(const std::string &title = "MCI Graph", int width = 1024,
+          int height = 768, bool offscreen = false) {
     // Init some variables
     _background = {0xEF, 0xEF, 0xEF};
     running = true;
-    // Init SDL
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    _frame = InputFrame{0, 0, 0};
+    _unconsumed = 0;
+    _latched = false;
+    _frame_index = 0;
+    _offscreen = offscreen;
+    _screen = NULL;
+    // Init SDL (only once for all contexts)
+    if (sdl_users() == 0 && SDL_Init(SDL_INIT_VIDEO) != 0) {
       throw MciGraphException("Could not init SDL: " +
                               std::string(SDL_GetError()));
     }
+    sdl_users()++;
 
     // Get the window
-    win = SDL_CreateWindow("MCI Graph", SDL_WINDOWPOS_CENTERED,
-                           SDL_WINDOWPOS_CENTERED, 1024, 768, SDL_WINDOW_SHOWN);
+    win = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED,
+                           SDL_WINDOWPOS_CENTERED, width, height,
+                           offscreen ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
     if (win == NULL) {
-      SDL_Quit();
+      release_sdl();
       throw MciGraphException("Could not create Window" +
                               std::string(SDL_GetError()));
     }
+    _window_id = SDL_GetWindowID(win);
 
     // Init the renderer
-    ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_PRESENTVSYNC);
+    ren = SDL_CreateRenderer(win, -1,
+                             offscreen ? SDL_RENDERER_TARGETTEXTURE
+                                       : SDL_RENDERER_PRESENTVSYNC);
 
     if (ren == NULL) {
       SDL_DestroyWindow(win);
       std::cout << "SDL_CreateRenderer Error: " << SDL_GetError() << std::endl;
-      SDL_Quit();
+      release_sdl();
       throw MciGraphException("Could not create renderer");
     }
+    if (offscreen) {
+      _screen = create_target(width, height);
+      set_target(NULL);
+    }
     // Init Texture Cache
     _texcache = TextureLoadCache(ren);
     // Init keystates
     _keystate = std::vector<bool>(284); // 284 is the highest key scancode
 
-    delay = 17;
+    delay = offscreen ? 0 : 17;
+    contexts().push_back(this);
   }
 
 public:
@@ -153,35 +458,89 @@ public:
 
   /// Present the screen to user and do some message handling
   void present() {
-    SDL_Event e;
-    while (SDL_PollEvent(&e)) {
-      switch (e.type) {
-      case SDL_QUIT: {
-        running = false;
-        break;
-      }
-      case SDL_KEYDOWN: { // On keydown set keystate to true
-        auto ev = reinterpret_cast<SDL_KeyboardEvent *>(&e);
-        _keystate.at(ev->keysym.scancode) = true;
-        break;
-      }
-      case SDL_KEYUP: { // On keyup set keystate to false
-        auto ev = reinterpret_cast<SDL_KeyboardEvent *>(&e);
-        _keystate.at(ev->keysym.scancode) = false;
-        break;
-      }
-      default:
-        break;
-      }
+    dispatch_events();
+    if (!_offscreen)
+      SDL_RenderPresent(ren); // Show drawn frame
+    clear();                  // Clear screen after picture is shown
+    SDL_Delay(delay);         // Wait for a little bit
+    SDL_PumpEvents();         // Update events
+    if (_latched)
+      next_frame();
+  }
+
+  /// Create a texture that can be drawn into after selecting it with
+  /// set_target(). It is destroyed together with the context.
+  SDL_Texture *create_target(int width, int height) {
+    SDL_Texture *target =
+        SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888,
+                          SDL_TEXTUREACCESS_TARGET, width, height);
+    if (target == NULL)
+      throw MciGraphException("Could not create render target: " +
+                              std::string(SDL_GetError()));
+    _targets.push_back(target);
+    return target;
+  }
+
+  /// Draw into the given target, NULL selects the window (or the offscreen
+  /// screen texture)
+  void set_target(SDL_Texture *target) {
+    if (target == NULL)
+      target = _screen;
+    if (SDL_SetRenderTarget(ren, target) < 0)
+      throw MciGraphException(SDL_GetError());
+  }
+
+  /// Read the pixels of the current target as ARGB8888. Call before
+  /// present(), which clears the target.
+  void read_pixels(std::vector<uint32_t> &pixels, int &width, int &height) {
+    if (SDL_GetRendererOutputSize(ren, &width, &height) < 0)
+      throw MciGraphException(SDL_GetError());
+    SDL_Texture *target = SDL_GetRenderTarget(ren);
+    if (target != NULL)
+      SDL_QueryTexture(target, NULL, NULL, &width, &height);
+    pixels.resize(width * height);
+    if (SDL_RenderReadPixels(ren, NULL, SDL_PIXELFORMAT_ARGB8888,
+                             pixels.data(), width * 4) < 0)
+      throw MciGraphException(SDL_GetError());
+  }
+
+  /// Start recording the input of every frame to the given file. The seed
+  /// is stored in the file so a replay can reproduce random numbers.
+  void start_recording(const std::string &filename, uint64_t seed) {
+    _replayer.reset();
+    _recorder.reset(new InputRecorder(filename, seed));
+    latch(capture_frame(0));
+    _frame_index = 0;
+    _latched = true;
+  }
+
+  /// Replay the input of a recorded file as fast as possible. Returns the
+  /// seed the recording was started with.
+  uint64_t start_replay(const std::string &filename) {
+    _recorder.reset();
+    _replayer.reset(new InputReplayer(filename));
+    latch(_replayer->next());
+    _frame_index = 0;
+    _latched = true;
+    delay = 0;
+    return _replayer->seed();
+  }
+
+  /// Report the hash of the game state for the current frame. While
+  /// replaying it is compared to the recorded hash.
+  void set_state_hash(uint64_t hash) {
+    if (_replayer && _frame.hash != hash) {
+      running = false;
+      throw MciGraphException("Replay diverged at frame " +
+                              std::to_string(_frame_index));
     }
-    SDL_RenderPresent(ren); // Show drawn frame
-    clear();                // Clear screen after picture is shown
-    SDL_Delay(delay);       // Wait for a little bit
-    SDL_PumpEvents();       // Update events
+    _frame.hash = hash;
   }
 
   /// Check if given key is currently pressed
   bool is_pressed(const Uint8 key) {
+    if (_latched)
+      return (_frame.held & recorded_key_bit(key)) != 0;
     SDL_PumpEvents(); // Update Keymap
     auto keymap = SDL_GetKeyboardState(NULL);
     if (keymap == NULL)
@@ -191,6 +550,12 @@ public:
 
   /// Check if given key was pressed since last checking
   bool was_pressed(const Uint8 key) {
+    if (_latched) {
+      uint32_t bit = recorded_key_bit(key);
+      bool pressed = (_unconsumed & bit) != 0;
+      _unconsumed &= ~bit; // _frame keeps the press for the recording
+      return pressed;
+    }
     if (_keystate.at(key) == true) {
       _keystate.at(key) = false;
       return true;
@@ -236,25 +601,172 @@ public:
     SDL_RenderCopy(ren, tex, NULL, &dest_rect);
   }
 
-  ~MciGraph() {
+  /// Collision mask of an image (given as a file on disc), magenta pixels
+  /// are transparent. Masks are cached together with the textures.
+  const CollisionMask &collision_mask(std::string filename) {
+    return _texcache.mask(filename);
+  }
+
+  ~Context() {
+    auto &all = contexts();
+    for (std::size_t i = 0; i < all.size(); i++) {
+      if (all[i] == this) {
+        all.erase(all.begin() + i);
+        break;
+      }
+    }
+    // Free functions fall back to the default context instead of this one
+    if (current_context() == this)
+      current_context() = NULL;
+    _texcache.clear();
+    for (auto target : _targets)
+      SDL_DestroyTexture(target);
     SDL_DestroyRenderer(ren);
     SDL_DestroyWindow(win);
-    SDL_Quit();
+    release_sdl();
   }
 
-  // Use the singleton pattern to get one globally consistent MCIGraph instance
-  // from all points in the program
-  static MciGraph &get_instance() {
-    static MciGraph mcigraph;
-    return mcigraph;
+  /// The default context used by the free functions, created on first use
+  static Context &get_default() {
+    static Context context;
+    return context;
   }
 
+  // Kept for code written against the former singleton
+  static Context &get_instance() { return get_default(); }
+
 private:
-  // Prevent copying and assigning of MciGraph
-  MciGraph(const MciGraph &);
-  MciGraph &operator=(const MciGraph &);
+  // Number of living contexts, SDL is shut down with the last one
+  static int &sdl_users() {
+    static int users = 0;
+    return users;
+  }
+
+  static void release_sdl() {
+    if (--sdl_users() == 0)
+      SDL_Quit();
+  }
+
+  // All living contexts, used to route window events
+  static std::vector<Context *> &contexts() {
+    static std::vector<Context *> all;
+    return all;
+  }
+
+  // Poll all pending events and hand them to the context owning the window
+  // they belong to. Events without a window go to the first context.
+  static void dispatch_events() {
+    SDL_Event e;
+    while (SDL_PollEvent(&e)) {
+      if (e.type == SDL_QUIT) {
+        for (auto context : contexts())
+          context->running = false;
+        continue;
+      }
+      Uint32 id = 0;
+      if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP)
+        id = e.key.windowID;
+      else if (e.type == SDL_WINDOWEVENT)
+        id = e.window.windowID;
+      Context *receiver = contexts().empty() ? NULL : contexts().front();
+      for (auto context : contexts()) {
+        if (context->_window_id == id)
+          receiver = context;
+      }
+      if (receiver != NULL)
+        receiver->handle_event(e);
+    }
+  }
+
+  void handle_event(const SDL_Event &e) {
+    switch (e.type) {
+    case SDL_WINDOWEVENT: {
+      if (e.window.event == SDL_WINDOWEVENT_CLOSE)
+        running = false;
+      break;
+    }
+    case SDL_KEYDOWN: { // On keydown set keystate to true
+      _keystate.at(e.key.keysym.scancode) = true;
+      break;
+    }
+    case SDL_KEYUP: { // On keyup set keystate to false
+      _keystate.at(e.key.keysym.scancode) = false;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+private:
+  // Build a snapshot of the live keyboard state. Presses that were not
+  // consumed by was_pressed are carried over like in unlatched mode.
+  InputFrame capture_frame(uint32_t unconsumed) {
+    SDL_PumpEvents();
+    auto keymap = SDL_GetKeyboardState(NULL);
+    if (keymap == NULL)
+      throw MciGraphException(SDL_GetError());
+    InputFrame frame{0, unconsumed, 0};
+    for (int i = 0; i < RECORDED_KEY_COUNT; i++) {
+      if (keymap[RECORDED_KEYS[i]])
+        frame.held |= 1u << i;
+      if (_keystate.at(RECORDED_KEYS[i])) {
+        frame.pressed |= 1u << i;
+        _keystate.at(RECORDED_KEYS[i]) = false;
+      }
+    }
+    return frame;
+  }
+
+  // Finish the current frame and latch the input of the next one
+  void next_frame() {
+    _frame_index++;
+    if (_recorder) {
+      _recorder->write(_frame);
+      latch(capture_frame(_unconsumed));
+    } else if (_replayer) {
+      if (_replayer->done()) {
+        running = false;
+        std::cout << "Replay finished after " << _frame_index << " frames"
+                  << std::endl;
+      }
+      latch(_replayer->next());
+    }
+  }
+
+  void latch(const InputFrame &frame) {
+    _frame = frame;
+    _unconsumed = frame.pressed;
+  }
+
+  // Prevent copying and assigning of Context
+  Context(const Context &);
+  Context &operator=(const Context &);
 };
 
+// The former name of Context
+typedef Context MciGraph;
+
+// Context used by the free functions. This is a plain pointer (no guarded
+// static) so routing a call costs a single load and compare.
+inline Context *&current_context() {
+  static Context *current = NULL;
+  return current;
+}
+
+/// The context the free functions draw to
+inline Context &current() {
+  Context *context = current_context();
+  if (context == NULL) {
+    context = &Context::get_default();
+    current_context() = context;
+  }
+  return *context;
+}
+
+/// Let the free functions draw to the given context
+inline void set_current(Context &context) { current_context() = &context; }
+
 } // namespace mcigraph
 
 // Some fishy stuff is going on after here. This is only done to
@@ -284,10 +796,10 @@ const auto KEY_D = SDL_SCANCODE_D;
 
 const auto KEY_SPACE = SDL_SCANCODE_SPACE;
 
-#define ___MCILOOPSTART___ while (mcigraph::MciGraph::get_instance().running) {
+#define ___MCILOOPSTART___ while (mcigraph::current().running) {
 
 #define ___MCILOOPEND___                                                       \
-  mcigraph::MciGraph::get_instance().present();                                \
+  mcigraph::current().present();                                               \
   }
 
 // All the following "easy-access-functions" are defined to be inline
@@ -296,33 +808,45 @@ const auto KEY_SPACE = SDL_SCANCODE_SPACE;
 // one file
 
 inline bool is_pressed(const Uint8 key) {
-  return mcigraph::MciGraph::get_instance().is_pressed(key);
+  return mcigraph::current().is_pressed(key);
 }
 inline bool was_pressed(const Uint8 key) {
-  return mcigraph::MciGraph::get_instance().was_pressed(key);
+  return mcigraph::current().was_pressed(key);
 }
 inline void draw_rect(int x, int y, int width, int height, bool outline = false,
                int red = 0x00, int green = 0x00, int blue = 0x00) {
-  mcigraph::MciGraph::get_instance().draw_rect(x, y, width, height, outline,
-                                               red, green, blue);
+  mcigraph::current().draw_rect(x, y, width, height, outline, red, green,
+                                blue);
 }
 inline void draw_line(int x1, int y1, int x2, int y2, int red = 0x00, int green = 0x00,
                int blue = 0x00) {
-  mcigraph::MciGraph::get_instance().draw_line(x1, y1, x2, y2, red, green,
-                                               blue);
+  mcigraph::current().draw_line(x1, y1, x2, y2, red, green, blue);
 }
 inline void draw_point(int x, int y, int red = 0x00, int green = 0x00,
                 int blue = 0x00) {
-  mcigraph::MciGraph::get_instance().draw_point(x, y, red, green, blue);
+  mcigraph::current().draw_point(x, y, red, green, blue);
 }
 inline void draw_image(std::string filename, int x = 0, int y = 0) {
-  mcigraph::MciGraph::get_instance().draw_image(filename, x, y);
+  mcigraph::current().draw_image(filename, x, y);
+}
+inline const mcigraph::CollisionMask &collision_mask(std::string filename) {
+  return mcigraph::current().collision_mask(filename);
+}
+
+inline void start_recording(const std::string &filename, uint64_t seed) {
+  mcigraph::current().start_recording(filename, seed);
+}
+inline uint64_t start_replay(const std::string &filename) {
+  return mcigraph::current().start_replay(filename);
+}
+inline void set_state_hash(uint64_t hash) {
+  mcigraph::current().set_state_hash(hash);
 }
 
-inline void set_delay(int delay) { mcigraph::MciGraph::get_instance().delay = delay; }
+inline void set_delay(int delay) { mcigraph::current().delay = delay; }
 
-inline int running() { return mcigraph::MciGraph::get_instance().running; }
-inline void present() { mcigraph::MciGraph::get_instance().present(); }
+inline int running() { return mcigraph::current().running; }
+inline void present() { mcigraph::current().present(); }
 
 #endif /* MCIGRAPH_H */
 
@@ -0,0 +1,232 @@
+#ifndef MCIJOBS_H
+#define MCIJOBS_H
+
+// Lightweight work-stealing job system. Every worker thread owns a deque of
+// ready jobs: it pushes and pops at the back (newest first, cache friendly)
+// while idle workers steal from the front of other deques (oldest first,
+// usually the largest pieces of work). Jobs submitted from outside the pool
+// go to a shared injection queue.
+//
+// A job may depend on other jobs and only becomes ready once all of them are
+// finished. wait() does not block while there is work: the waiting thread
+// runs jobs itself, so jobs may submit and wait for jobs of their own and the
+// calling thread counts as one more worker.
+//
+// parallel_for splits an index range into chunks whose number depends only on
+// the grain size, never on the number of threads. Writing results into one
+// buffer per chunk and merging the buffers in chunk order therefore gives the
+// same output on every machine.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mcigraph {
+
+class JobSystem {
+private:
+  struct Job;
+
+public:
+  typedef std::shared_ptr<Job> JobHandle;
+
+private:
+  struct Job {
+    std::function<void()> fn;
+    std::atomic<int> waiting;  // Unfinished dependencies, ready at 0
+    std::atomic<bool> done;
+    std::mutex mutex;          // Guards dependents against a finishing job
+    std::vector<JobHandle> dependents;
+
+    Job() : waiting(0), done(false) {}
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<JobHandle> jobs;
+  };
+
+  std::vector<std::thread> _threads;
+  std::vector<std::unique_ptr<Queue>> _queues; // One per worker, then the injection queue
+  std::atomic<int> _queued;                    // Ready jobs in all queues
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _stop = false;
+
+  // Index of the calling thread's queue in this job system, or the
+  // injection queue for threads that are not workers of this system
+  struct ThreadSlot {
+    const JobSystem *system;
+    int index;
+  };
+
+  static ThreadSlot &thread_slot() {
+    static thread_local ThreadSlot slot = {NULL, 0};
+    return slot;
+  }
+
+  int own_queue() const {
+    const ThreadSlot &slot = thread_slot();
+    return slot.system == this ? slot.index : static_cast<int>(_threads.size());
+  }
+
+public:
+  // Starts threads workers, 0 runs every job on the thread calling wait()
+  explicit JobSystem(int threads) : _queued(0) {
+    for (int i = 0; i <= threads; i++)
+      _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    for (int i = 0; i < threads; i++)
+      _threads.push_back(std::thread([this, i] { worker(i); }));
+  }
+
+  ~JobSystem() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &thread : _threads)
+      thread.join();
+  }
+
+  // Worker threads plus the thread calling wait()
+  int size() const { return static_cast<int>(_threads.size()) + 1; }
+
+  // Schedules fn to run once all jobs in after are finished
+  JobHandle submit(std::function<void()> fn,
+                   const std::vector<JobHandle> &after = std::vector<JobHandle>()) {
+    JobHandle job = std::make_shared<Job>();
+    job->fn = std::move(fn);
+    job->waiting = static_cast<int>(after.size()) + 1; // +1 until all are registered
+    int finished = 1;
+    for (const JobHandle &dependency : after) {
+      std::lock_guard<std::mutex> lock(dependency->mutex);
+      if (dependency->done)
+        finished++;
+      else
+        dependency->dependents.push_back(job);
+    }
+    if (job->waiting.fetch_sub(finished) == finished)
+      enqueue(job);
+    return job;
+  }
+
+  // Runs jobs until job is finished
+  void wait(const JobHandle &job) {
+    int self = own_queue();
+    while (!job->done) {
+      if (run_one(self))
+        continue;
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [&] { return job->done || _queued > 0; });
+    }
+  }
+
+  void wait(const std::vector<JobHandle> &jobs) {
+    for (const JobHandle &job : jobs)
+      wait(job);
+  }
+
+  // Calls fn(chunk, first, last) for consecutive ranges [first, last) of at
+  // most grain indices covering [begin, end) and waits for all of them.
+  // Chunk c always covers [begin + c * grain, ...), independent of size().
+  template <typename Fn>
+  void parallel_for(int begin, int end, int grain, Fn fn) {
+    int chunks = chunk_count(begin, end, grain);
+    if (chunks <= 1 || _threads.empty()) {
+      for (int c = 0; c < chunks; c++)
+        fn(c, begin + c * grain, std::min(end, begin + (c + 1) * grain));
+      return;
+    }
+    std::vector<JobHandle> jobs;
+    jobs.reserve(chunks);
+    for (int c = 0; c < chunks; c++) {
+      int first = begin + c * grain, last = std::min(end, first + grain);
+      jobs.push_back(submit([&fn, c, first, last] { fn(c, first, last); }));
+    }
+    wait(jobs);
+  }
+
+  static int chunk_count(int begin, int end, int grain) {
+    return end > begin ? (end - begin + grain - 1) / grain : 0;
+  }
+
+private:
+  void enqueue(const JobHandle &job) {
+    Queue &queue = *_queues[own_queue()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(job);
+    }
+    _queued++;
+    { std::lock_guard<std::mutex> lock(_mutex); }
+    _wake.notify_all();
+  }
+
+  // Own queue from the back, then the other queues from the front
+  bool run_one(int self) {
+    JobHandle job;
+    int count = static_cast<int>(_queues.size());
+    for (int k = 0; k < count && !job; k++) {
+      Queue &queue = *_queues[(self + k) % count];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.jobs.empty())
+        continue;
+      if (k == 0) {
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+      } else {
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+      }
+    }
+    if (!job)
+      return false;
+    _queued--;
+    execute(job);
+    return true;
+  }
+
+  void execute(const JobHandle &job) {
+    job->fn();
+    job->fn = nullptr;
+    std::vector<JobHandle> dependents;
+    {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      job->done = true;
+      dependents.swap(job->dependents);
+    }
+    for (const JobHandle &dependent : dependents) {
+      if (dependent->waiting.fetch_sub(1) == 1)
+        enqueue(dependent);
+    }
+    { std::lock_guard<std::mutex> lock(_mutex); } // Wake threads waiting for job
+    _wake.notify_all();
+  }
+
+  void worker(int index) {
+    thread_slot().system = this;
+    thread_slot().index = index;
+    while (true) {
+      if (run_one(index))
+        continue;
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this] { return _stop || _queued > 0; });
+      if (_stop)
+        return;
+    }
+  }
+
+  JobSystem(const JobSystem &);
+  JobSystem &operator=(const JobSystem &);
+};
+
+} // namespace mcigraph
+
+#endif /* MCIJOBS_H */
@@ -0,0 +1,222 @@
+#ifndef MCIRANDOM_H
+#define MCIRANDOM_H
+
+// Small, fast pseudo random number generators with explicit state, so every
+// game instance, subsystem and thread can own an independent stream instead
+// of sharing the global, locked rand().
+//
+//   Pcg32          32-bit PCG (XSH RR). Stream selects one of 2^63 independent
+//                  sequences, which is used to give each subsystem its own.
+//   Xoshiro256ss   64-bit xoshiro256**. jump() advances by 2^128 steps to
+//                  split one seed into non-overlapping streams.
+//   DirectionFill  Four xoshiro128** lanes, stepped together with SSE2 where
+//                  available, that fill buffers with random directions 0-3.
+//
+// All generators satisfy the standard UniformRandomBitGenerator requirements
+// and produce the same sequences on every platform.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MCIRANDOM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace mcigraph {
+
+// Expands a seed into well mixed state words
+inline uint64_t splitmix64(uint64_t &state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+class Pcg32 {
+private:
+  uint64_t _state;
+  uint64_t _inc; // Always odd, selects the stream
+
+public:
+  typedef uint32_t result_type;
+
+  explicit Pcg32(uint64_t seed = 0x853C49E6748FEA9BULL, uint64_t stream = 0)
+      : _state(0), _inc((stream << 1) | 1) {
+    (*this)();
+    _state += seed;
+    (*this)();
+  }
+
+  uint32_t operator()() {
+    uint64_t old = _state;
+    _state = old * 6364136223846793005ULL + _inc;
+    uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    uint32_t rot = static_cast<uint32_t>(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+  }
+
+  // Uniform value in [0, bound) without modulo bias (Lemire's method)
+  uint32_t bounded(uint32_t bound) {
+    uint64_t m = static_cast<uint64_t>((*this)()) * bound;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < bound) {
+      uint32_t threshold = (0u - bound) % bound;
+      while (low < threshold) {
+        m = static_cast<uint64_t>((*this)()) * bound;
+        low = static_cast<uint32_t>(m);
+      }
+    }
+    return static_cast<uint32_t>(m >> 32);
+  }
+
+  static uint32_t min() { return 0; }
+  static uint32_t max() { return 0xFFFFFFFF; }
+};
+
+class Xoshiro256ss {
+private:
+  uint64_t _s[4];
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+  typedef uint64_t result_type;
+
+  explicit Xoshiro256ss(uint64_t seed = 0) {
+    for (int i = 0; i < 4; i++)
+      _s[i] = splitmix64(seed);
+  }
+
+  uint64_t operator()() {
+    uint64_t result = rotl(_s[1] * 5, 7) * 9;
+    uint64_t t = _s[1] << 17;
+    _s[2] ^= _s[0];
+    _s[3] ^= _s[1];
+    _s[1] ^= _s[2];
+    _s[0] ^= _s[3];
+    _s[2] ^= t;
+    _s[3] = rotl(_s[3], 45);
+    return result;
+  }
+
+  // Advances by 2^128 calls, for up to 2^128 non-overlapping streams
+  void jump() {
+    static const uint64_t JUMP[] = {0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                    0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+      for (int b = 0; b < 64; b++) {
+        if (JUMP[i] & (1ULL << b)) {
+          for (int k = 0; k < 4; k++)
+            s[k] ^= _s[k];
+        }
+        (*this)();
+      }
+    }
+    for (int k = 0; k < 4; k++)
+      _s[k] = s[k];
+  }
+
+  static uint64_t min() { return 0; }
+  static uint64_t max() { return ~0ULL; }
+};
+
+// Bulk generator for random directions. Each step of the four xoshiro128**
+// lanes yields 128 random bits, i.e. 64 directions of two bits each. The
+// SSE2 and the scalar path produce identical output.
+class DirectionFill {
+private:
+  uint32_t _s[4][4]; // _s[word][lane]
+
+  static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+  // One step of all lanes, writes 4 x 32 random bits
+  void next(uint32_t out[4]) {
+#ifdef MCIRANDOM_SSE2
+    __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_s[0]));
+    __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_s[1]));
+    __m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_s[2]));
+    __m128i s3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_s[3]));
+    // result = rotl(s1 * 5, 7) * 9, with the multiplications as shift and add
+    __m128i m = _mm_add_epi32(_mm_slli_epi32(s1, 2), s1);
+    __m128i r = _mm_or_si128(_mm_slli_epi32(m, 7), _mm_srli_epi32(m, 25));
+    r = _mm_add_epi32(_mm_slli_epi32(r, 3), r);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), r);
+    __m128i t = _mm_slli_epi32(s1, 9);
+    s2 = _mm_xor_si128(s2, s0);
+    s3 = _mm_xor_si128(s3, s1);
+    s1 = _mm_xor_si128(s1, s2);
+    s0 = _mm_xor_si128(s0, s3);
+    s2 = _mm_xor_si128(s2, t);
+    s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_s[0]), s0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_s[1]), s1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_s[2]), s2);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_s[3]), s3);
+#else
+    for (int lane = 0; lane < 4; lane++) {
+      out[lane] = rotl(_s[1][lane] * 5, 7) * 9;
+      uint32_t t = _s[1][lane] << 9;
+      _s[2][lane] ^= _s[0][lane];
+      _s[3][lane] ^= _s[1][lane];
+      _s[1][lane] ^= _s[2][lane];
+      _s[0][lane] ^= _s[3][lane];
+      _s[2][lane] ^= t;
+      _s[3][lane] = rotl(_s[3][lane], 11);
+    }
+#endif
+  }
+
+public:
+  // Lane states come from splitmix64 of seed and stream, so different
+  // streams of the same seed are independent
+  explicit DirectionFill(uint64_t seed = 0, uint64_t stream = 0) {
+    uint64_t state = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    for (int lane = 0; lane < 4; lane++) {
+      uint64_t a = splitmix64(state), b = splitmix64(state);
+      _s[0][lane] = static_cast<uint32_t>(a);
+      _s[1][lane] = static_cast<uint32_t>(a >> 32);
+      _s[2][lane] = static_cast<uint32_t>(b);
+      _s[3][lane] = static_cast<uint32_t>(b >> 32) | 1; // never all zero
+    }
+  }
+
+  // Writes count directions (0-3) to out. Full blocks of 64 are unpacked
+  // with SSE2, the remainder of the last block is discarded.
+  void fill(uint8_t *out, size_t count) {
+    uint32_t bits[4];
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64) {
+      next(bits);
+#ifdef MCIRANDOM_SSE2
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bits));
+      __m128i mask = _mm_set1_epi8(3);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_and_si128(v, mask));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 16), _mm_and_si128(_mm_srli_epi16(v, 2), mask));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 32), _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 48), _mm_and_si128(_mm_srli_epi16(v, 6), mask));
+#else
+      unpack(bits, out + i, 64);
+#endif
+    }
+    if (i < count) {
+      next(bits);
+      unpack(bits, out + i, count - i);
+    }
+  }
+
+private:
+  // Scalar unpacking in the same order as the SSE2 path: direction k of a
+  // block is bit pair k / 16 of byte k % 16
+  static void unpack(const uint32_t bits[4], uint8_t *out, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+      uint32_t byte = (bits[(k % 16) / 4] >> ((k % 4) * 8)) & 0xFF;
+      out[k] = static_cast<uint8_t>((byte >> ((k / 16) * 2)) & 3);
+    }
+  }
+};
+
+} // namespace mcigraph
+
+#endif /* MCIRANDOM_H */
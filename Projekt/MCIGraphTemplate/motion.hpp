@@ -0,0 +1,122 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include "collision.hpp"
+#include <stdint.h>
+
+// Bewegung in Bruchteilen einer Kachel mit Festkommazahlen: eine Kachel sind
+// FIXED_ONE Einheiten, ein Pixel FIXED_PIXEL Einheiten. Alle Rechnungen sind
+// ganzzahlig, es gibt also keine Rundungsdrift und jeder Rechner kommt bei
+// gleichen Eingaben auf dieselben Positionen (wichtig fuer Replays).
+
+typedef int32_t fixed_t;
+
+const int FIXED_SHIFT = 8;
+const fixed_t FIXED_ONE = 1 << FIXED_SHIFT;
+const fixed_t FIXED_PIXEL = FIXED_ONE / 16;
+
+inline fixed_t to_fixed(int tiles) {
+    return tiles * FIXED_ONE;
+}
+
+// Kachel, in der die Position liegt (abgerundet, auch fuer negative Werte)
+inline int fixed_tile(fixed_t v) {
+    return v >= 0 ? v / FIXED_ONE : -((-v + FIXED_ONE - 1) / FIXED_ONE);
+}
+
+inline int fixed_pixel(fixed_t v) {
+    return v >= 0 ? v / FIXED_PIXEL : -((-v + FIXED_PIXEL - 1) / FIXED_PIXEL);
+}
+
+// Achsenparalleles Rechteck mit Geschwindigkeit pro Tick
+struct Body {
+    fixed_t x, y;   // linke obere Ecke
+    fixed_t w, h;   // Breite und Hoehe, hoechstens eine Kachel
+    fixed_t vx, vy; // Geschwindigkeit in Einheiten pro Tick
+};
+
+// true, wenn eine der Kacheln row1..row2 in Spalte column blockiert ist
+inline bool column_blocked(const CollisionGrid& stop, int column, int row1, int row2) {
+    for (int row = row1; row <= row2; row++) {
+        if (stop.blocked(column, row))
+            return true;
+    }
+    return false;
+}
+
+inline bool row_blocked(const CollisionGrid& stop, int row, int column1, int column2) {
+    for (int column = column1; column <= column2; column++) {
+        if (stop.blocked(column, row))
+            return true;
+    }
+    return false;
+}
+
+// Bewegt body um (vx, vy) mit einem Sweep gegen das Kachelgitter: erst
+// waagrecht, dann senkrecht wird die erste blockierte Spalte bzw. Zeile auf
+// dem Weg gesucht und der Koerper buendig davor angehalten. Dadurch kann er
+// auch bei hoher Geschwindigkeit nicht durch duenne Waende tunneln. Die
+// Geschwindigkeit einer angehaltenen Achse wird 0. Gibt true zurueck, wenn
+// eine Wand getroffen wurde.
+inline bool sweep_move(Body& body, const CollisionGrid& stop) {
+    bool hit = false;
+    if (body.vx != 0) {
+        int row1 = fixed_tile(body.y), row2 = fixed_tile(body.y + body.h - 1);
+        fixed_t target = body.x + body.vx;
+        if (body.vx > 0) { // Spalten rechts der bisherigen rechten Kante
+            int last = fixed_tile(target + body.w - 1);
+            for (int column = fixed_tile(body.x + body.w - 1) + 1; column <= last; column++) {
+                if (column_blocked(stop, column, row1, row2)) {
+                    target = to_fixed(column) - body.w;
+                    hit = true;
+                    break;
+                }
+            }
+        }
+        else {
+            int last = fixed_tile(target);
+            for (int column = fixed_tile(body.x) - 1; column >= last; column--) {
+                if (column_blocked(stop, column, row1, row2)) {
+                    target = to_fixed(column + 1);
+                    hit = true;
+                    break;
+                }
+            }
+        }
+        if (hit)
+            body.vx = 0;
+        body.x = target;
+    }
+    if (body.vy != 0) {
+        bool hit_y = false;
+        int column1 = fixed_tile(body.x), column2 = fixed_tile(body.x + body.w - 1);
+        fixed_t target = body.y + body.vy;
+        if (body.vy > 0) {
+            int last = fixed_tile(target + body.h - 1);
+            for (int row = fixed_tile(body.y + body.h - 1) + 1; row <= last; row++) {
+                if (row_blocked(stop, row, column1, column2)) {
+                    target = to_fixed(row) - body.h;
+                    hit_y = true;
+                    break;
+                }
+            }
+        }
+        else {
+            int last = fixed_tile(target);
+            for (int row = fixed_tile(body.y) - 1; row >= last; row--) {
+                if (row_blocked(stop, row, column1, column2)) {
+                    target = to_fixed(row + 1);
+                    hit_y = true;
+                    break;
+                }
+            }
+        }
+        if (hit_y)
+            body.vy = 0;
+        body.y = target;
+        hit = hit || hit_y;
+    }
+    return hit;
+}
+
+#endif /* MOTION_H */
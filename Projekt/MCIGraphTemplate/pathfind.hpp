@@ -0,0 +1,567 @@
+#ifndef PATHFIND_H
+#define PATHFIND_H
+
+#include "collision.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Wegfindung auf dem CollisionGrid.
+//
+// FlowField: eine Breitensuche vom Ziel aus ueber alle begehbaren Kacheln
+// speichert pro Kachel den Abstand zum Ziel und die Richtung des naechsten
+// Schritts. Beliebig viele Verfolger lesen ihren Schritt dann in O(1), die
+// Kosten haengen nur von der Kartengroesse ab, nicht von der Anzahl der Monster.
+//
+// HierarchicalPathfinder (HPA*): Wege zwischen zwei beliebigen Kacheln auf
+// grossen Karten. Die Karte wird in Cluster zerlegt, an jedem freien
+// Abschnitt einer Clustergrenze liegt ein Knotenpaar (Uebergang). Der
+// abstrakte Graph verbindet die Uebergaenge untereinander (Kosten aus einer
+// Breitensuche im Cluster) und ueber die Grenze (Kosten 1). Eine Suche laeuft
+// erst auf diesem kleinen Graphen, danach wird jeder Abschnitt innerhalb
+// seines Clusters verfeinert. Verfeinerte Abschnitte landen in einem LRU-Cache.
+
+const uint8_t DIR_NONE = 4;                // keine Richtung, Ziel nicht erreichbar
+const uint16_t FLOW_UNREACHABLE = 0xFFFF; // Abstand unerreichbarer Kacheln
+
+class FlowField {
+private:
+    int _width, _height;
+    int _target_x = -1, _target_y = -1;
+    bool _valid = false;
+    std::vector<uint16_t> _distance;
+    std::vector<uint8_t> _direction;
+    std::vector<int> _queue;
+
+public:
+    FlowField(int width = 64, int height = 48)
+        : _width(width), _height(height), _distance(width * height, FLOW_UNREACHABLE),
+          _direction(width * height, DIR_NONE) {
+        _queue.reserve(width * height);
+    }
+
+    // Rechnet das Feld nur neu, wenn sich das Ziel oder (nach invalidate) die
+    // Karte geaendert hat. Gibt true zurueck, wenn neu gerechnet wurde.
+    bool update(const CollisionGrid& grid, int target_x, int target_y) {
+        if (_valid && target_x == _target_x && target_y == _target_y)
+            return false;
+        _target_x = target_x;
+        _target_y = target_y;
+        _valid = true;
+        build(grid);
+        return true;
+    }
+
+    // Nach Aenderungen am CollisionGrid aufrufen
+    void invalidate() {
+        _valid = false;
+    }
+
+    int distance(int x, int y) const {
+        return _distance[y * _width + x];
+    }
+
+    // DIR_UP, DIR_DOWN, DIR_LEFT, DIR_RIGHT oder DIR_NONE
+    uint8_t direction(int x, int y) const {
+        return _direction[y * _width + x];
+    }
+
+private:
+    void build(const CollisionGrid& grid) {
+        std::fill(_distance.begin(), _distance.end(), FLOW_UNREACHABLE);
+        _queue.clear();
+        if (_target_x < 0 || _target_x >= _width || _target_y < 0 || _target_y >= _height) {
+            std::fill(_direction.begin(), _direction.end(), DIR_NONE);
+            return;
+        }
+
+        // Breitensuche, der Rand des CollisionGrid ist blockiert und braucht keine Pruefung
+        const int dx[4] = { 0, 0, -1, 1 };
+        const int dy[4] = { -1, 1, 0, 0 };
+        int start = _target_y * _width + _target_x;
+        _distance[start] = 0;
+        _queue.push_back(start);
+        for (size_t head = 0; head < _queue.size(); head++) {
+            int tile = _queue[head];
+            int x = tile % _width, y = tile / _width;
+            uint16_t next = static_cast<uint16_t>(_distance[tile] + 1);
+            for (int d = 0; d < 4; d++) {
+                int nx = x + dx[d], ny = y + dy[d];
+                if (grid.blocked(nx, ny))
+                    continue;
+                int n = ny * _width + nx;
+                if (_distance[n] == FLOW_UNREACHABLE) {
+                    _distance[n] = next;
+                    _queue.push_back(n);
+                }
+            }
+        }
+
+        // Richtung zum Nachbarn mit dem kleinsten Abstand. Auch blockierte
+        // Kacheln bekommen eine Richtung, damit dort gespawnte Monster herausfinden.
+        for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+                int tile = y * _width + x;
+                uint16_t best = _distance[tile];
+                uint8_t direction = DIR_NONE;
+                for (int d = 0; d < 4; d++) {
+                    int nx = x + dx[d], ny = y + dy[d];
+                    if (nx < 0 || nx >= _width || ny < 0 || ny >= _height)
+                        continue;
+                    if (_distance[ny * _width + nx] < best) {
+                        best = _distance[ny * _width + nx];
+                        direction = static_cast<uint8_t>(d);
+                    }
+                }
+                _direction[tile] = direction;
+            }
+        }
+    }
+};
+
+typedef std::vector<std::pair<int, int> > TilePath;
+
+class HierarchicalPathfinder {
+private:
+    struct Edge {
+        int to;
+        int cost;
+        bool inter; // Uebergang ueber eine Clustergrenze
+    };
+
+    struct Node {
+        int x, y;
+        int cluster;
+        std::vector<Edge> edges;
+    };
+
+    struct Segment {
+        uint64_t key;  // Start- und Zielkachel
+        int cluster;
+        TilePath tiles; // ohne Start, mit Ziel
+    };
+
+    const CollisionGrid* _grid;
+    int _cluster_size, _columns, _rows;
+
+    std::vector<Node> _nodes;
+    std::vector<int> _free_nodes;
+    std::vector<std::vector<int> > _cluster_nodes;
+    std::vector<std::vector<int> > _border_nodes; // zwei Grenzen pro Cluster: rechts und unten
+    std::vector<uint8_t> _border_dirty, _cluster_dirty;
+    std::vector<int> _dirty_borders, _dirty_clusters;
+
+    std::vector<int16_t> _local; // Abstaende der letzten Breitensuche im Cluster
+
+    std::vector<int> _cost, _parent; // abstrakte Suche, gueltig wenn _visit == _search
+    std::vector<uint32_t> _visit;
+    uint32_t _search = 0;
+    std::vector<std::pair<int, int> > _start_edges, _goal_edges; // (Knoten, Kosten)
+    std::vector<int> _route;
+
+    size_t _cache_capacity;
+    std::list<Segment> _cache; // vorne die zuletzt benutzten
+    std::unordered_map<uint64_t, std::list<Segment>::iterator> _cache_index;
+    size_t _cache_hits = 0, _cache_misses = 0;
+
+public:
+    // grid muss laenger leben als der Pathfinder, cluster_size hoechstens 64
+    HierarchicalPathfinder(const CollisionGrid& grid, int cluster_size = 16, size_t cache_capacity = 1024)
+        : _grid(&grid), _cluster_size(cluster_size), _columns((grid.width() + cluster_size - 1) / cluster_size),
+          _rows((grid.height() + cluster_size - 1) / cluster_size), _cluster_nodes(_columns * _rows),
+          _border_nodes(_columns * _rows * 2), _border_dirty(_columns * _rows * 2, 0),
+          _cluster_dirty(_columns * _rows, 0), _local(cluster_size * cluster_size), _cache_capacity(cache_capacity) {
+        for (int c = 0; c < _columns * _rows; c++) {
+            mark_border(c * 2);
+            mark_border(c * 2 + 1);
+        }
+        refresh();
+    }
+
+    // Nach einer Aenderung der Kachel (x, y) im CollisionGrid aufrufen. Die
+    // betroffenen Cluster werden vor der naechsten Suche neu verbunden.
+    void tile_changed(int x, int y) {
+        int cx = x / _cluster_size, cy = y / _cluster_size;
+        int c = cy * _columns + cx;
+        mark_border(c * 2);
+        mark_border(c * 2 + 1);
+        if (cx > 0)
+            mark_border((c - 1) * 2);
+        if (cy > 0)
+            mark_border((c - _columns) * 2 + 1);
+        mark_cluster(c);
+    }
+
+    // Baut alle markierten Grenzen und Cluster neu auf
+    void refresh() {
+        for (size_t i = 0; i < _dirty_borders.size(); i++)
+            rebuild_border(_dirty_borders[i]);
+        for (size_t i = 0; i < _dirty_borders.size(); i++)
+            _border_dirty[_dirty_borders[i]] = 0;
+        _dirty_borders.clear();
+        if (_dirty_clusters.empty())
+            return;
+        for (size_t i = 0; i < _dirty_clusters.size(); i++)
+            rebuild_cluster(_dirty_clusters[i]);
+        for (auto it = _cache.begin(); it != _cache.end();) { // Abschnitte in geaenderten Clustern verwerfen
+            if (_cluster_dirty[it->cluster]) {
+                _cache_index.erase(it->key);
+                it = _cache.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        for (size_t i = 0; i < _dirty_clusters.size(); i++)
+            _cluster_dirty[_dirty_clusters[i]] = 0;
+        _dirty_clusters.clear();
+    }
+
+    // Sucht einen kuerzesten Weg im abstrakten Graphen und verfeinert ihn zu
+    // einzelnen Kacheln, von (x1, y1) bis einschliesslich (x2, y2). Der Weg ist
+    // nahezu optimal, da die Uebergaenge nur in der Mitte jedes Grenzabschnitts
+    // liegen. Gibt false zurueck, wenn es keinen Weg gibt.
+    bool find_path(int x1, int y1, int x2, int y2, TilePath& path) {
+        path.clear();
+        refresh();
+        if (_grid->blocked(x1, y1) || _grid->blocked(x2, y2))
+            return false;
+        path.push_back(std::make_pair(x1, y1));
+        if (x1 == x2 && y1 == y2)
+            return true;
+
+        int start_cluster = cluster_of(x1, y1), goal_cluster = cluster_of(x2, y2);
+        if (start_cluster == goal_cluster) { // zuerst direkt im Cluster versuchen
+            flood(start_cluster, x2, y2);
+            if (local(start_cluster, x1, y1) >= 0) {
+                walk(start_cluster, x1, y1, path);
+                return true;
+            }
+        }
+
+        // Start und Ziel voruebergehend mit den Uebergaengen ihres Clusters verbinden
+        connect(start_cluster, x1, y1, _start_edges);
+        connect(goal_cluster, x2, y2, _goal_edges);
+        if (_start_edges.empty() || _goal_edges.empty() || !search(x1, y1, x2, y2)) {
+            path.clear();
+            return false;
+        }
+
+        // Route verfeinern: ueber Grenzen ein Schritt, im Cluster ein gecachter Abschnitt
+        int goal = static_cast<int>(_nodes.size()) + 1;
+        int px = x1, py = y1;
+        for (size_t i = 0; i < _route.size(); i++) {
+            int id = _route[i];
+            int qx = id == goal ? x2 : _nodes[id].x, qy = id == goal ? y2 : _nodes[id].y;
+            int c = cluster_of(px, py);
+            if (c != cluster_of(qx, qy))
+                path.push_back(std::make_pair(qx, qy));
+            else
+                append_segment(c, px, py, qx, qy, path);
+            px = qx;
+            py = qy;
+        }
+        return true;
+    }
+
+    size_t node_count() const {
+        return _nodes.size() - _free_nodes.size();
+    }
+    size_t cache_hits() const {
+        return _cache_hits;
+    }
+    size_t cache_misses() const {
+        return _cache_misses;
+    }
+
+private:
+    int cluster_of(int x, int y) const {
+        return (y / _cluster_size) * _columns + x / _cluster_size;
+    }
+
+    void cluster_bounds(int c, int& x1, int& y1, int& x2, int& y2) const {
+        x1 = (c % _columns) * _cluster_size;
+        y1 = (c / _columns) * _cluster_size;
+        x2 = std::min(x1 + _cluster_size, _grid->width());
+        y2 = std::min(y1 + _cluster_size, _grid->height());
+    }
+
+    void mark_border(int b) {
+        if (!_border_dirty[b]) {
+            _border_dirty[b] = 1;
+            _dirty_borders.push_back(b);
+        }
+    }
+
+    void mark_cluster(int c) {
+        if (!_cluster_dirty[c]) {
+            _cluster_dirty[c] = 1;
+            _dirty_clusters.push_back(c);
+        }
+    }
+
+    int add_node(int x, int y, int cluster) {
+        int id;
+        if (_free_nodes.empty()) {
+            id = static_cast<int>(_nodes.size());
+            _nodes.push_back(Node());
+        }
+        else {
+            id = _free_nodes.back();
+            _free_nodes.pop_back();
+        }
+        _nodes[id].x = x;
+        _nodes[id].y = y;
+        _nodes[id].cluster = cluster;
+        _nodes[id].edges.clear();
+        _cluster_nodes[cluster].push_back(id);
+        return id;
+    }
+
+    void link(int a, int b, int cost, bool inter) {
+        Edge ab = { b, cost, inter }, ba = { a, cost, inter };
+        _nodes[a].edges.push_back(ab);
+        _nodes[b].edges.push_back(ba);
+    }
+
+    // Entfernt die Uebergaenge einer Grenze und legt sie fuer jeden
+    // zusammenhaengenden freien Abschnitt neu an, beide Cluster werden markiert
+    void rebuild_border(int b) {
+        int c = b / 2;
+        bool right = b % 2 == 0;
+        for (size_t i = 0; i < _border_nodes[b].size(); i++) {
+            int id = _border_nodes[b][i];
+            std::vector<int>& owner = _cluster_nodes[_nodes[id].cluster];
+            owner.erase(std::find(owner.begin(), owner.end(), id));
+            mark_cluster(_nodes[id].cluster);
+            _nodes[id].edges.clear();
+            _free_nodes.push_back(id);
+        }
+        _border_nodes[b].clear();
+        mark_cluster(c);
+
+        if (right ? c % _columns == _columns - 1 : c / _columns == _rows - 1)
+            return; // Rand der Karte
+        int neighbor = right ? c + 1 : c + _columns;
+        mark_cluster(neighbor);
+        int x1, y1, x2, y2;
+        cluster_bounds(c, x1, y1, x2, y2);
+        int length = right ? y2 - y1 : x2 - x1;
+        int run = 0;
+        for (int i = 0; i <= length; i++) {
+            int ax = right ? x2 - 1 : x1 + i, ay = right ? y1 + i : y2 - 1;
+            int bx = right ? ax + 1 : ax, by = right ? ay : ay + 1;
+            if (i < length && !_grid->blocked(ax, ay) && !_grid->blocked(bx, by)) {
+                run++;
+                continue;
+            }
+            if (run > 0) { // Uebergang in der Mitte des Abschnitts
+                int m = i - 1 - (run - 1) / 2;
+                int ux = right ? x2 - 1 : x1 + m, uy = right ? y1 + m : y2 - 1;
+                int a = add_node(ux, uy, c);
+                int n = add_node(right ? ux + 1 : ux, right ? uy : uy + 1, neighbor);
+                link(a, n, 1, true);
+                _border_nodes[b].push_back(a);
+                _border_nodes[b].push_back(n);
+            }
+            run = 0;
+        }
+    }
+
+    // Verbindet alle Uebergaenge eines Clusters untereinander neu
+    void rebuild_cluster(int c) {
+        std::vector<int>& nodes = _cluster_nodes[c];
+        for (size_t i = 0; i < nodes.size(); i++) {
+            std::vector<Edge>& edges = _nodes[nodes[i]].edges;
+            edges.erase(std::remove_if(edges.begin(), edges.end(), [](const Edge& e) { return !e.inter; }), edges.end());
+        }
+        for (size_t i = 0; i < nodes.size(); i++) {
+            flood(c, _nodes[nodes[i]].x, _nodes[nodes[i]].y);
+            for (size_t j = i + 1; j < nodes.size(); j++) {
+                int d = local(c, _nodes[nodes[j]].x, _nodes[nodes[j]].y);
+                if (d >= 0)
+                    link(nodes[i], nodes[j], d, false);
+            }
+        }
+    }
+
+    // Breitensuche von (x, y) innerhalb des Clusters c, Ergebnis in _local.
+    // Laeuft bitparallel ueber die Zeilen des CollisionGrid: jede Zeile des
+    // Clusters ist ein Wort, eine Schicht der Suche sind ein paar Shifts pro Zeile.
+    void flood(int c, int x, int y) {
+        int x1, y1, x2, y2;
+        cluster_bounds(c, x1, y1, x2, y2);
+        int rows = y2 - y1;
+        uint64_t mask = x2 - x1 == 64 ? ~0ULL : (1ULL << (x2 - x1)) - 1;
+        uint64_t open[64], seen[64], front[64], next[64];
+        for (int r = 0; r < rows; r++) {
+            open[r] = ~_grid->row_bits(x1, y1 + r) & mask;
+            seen[r] = front[r] = 0;
+        }
+        std::fill(_local.begin(), _local.end(), -1);
+        front[y - y1] = seen[y - y1] = 1ULL << (x - x1);
+        _local[(y - y1) * _cluster_size + (x - x1)] = 0;
+        for (int16_t distance = 1;; distance++) {
+            bool grown = false;
+            for (int r = 0; r < rows; r++) {
+                uint64_t n = (front[r] << 1) | (front[r] >> 1);
+                if (r > 0)
+                    n |= front[r - 1];
+                if (r + 1 < rows)
+                    n |= front[r + 1];
+                next[r] = n & open[r] & ~seen[r];
+            }
+            for (int r = 0; r < rows; r++) {
+                uint64_t n = next[r];
+                seen[r] |= n;
+                front[r] = n;
+                grown = grown || n != 0;
+                for (; n != 0; n &= n - 1)
+                    _local[r * _cluster_size + lowest_bit(n)] = distance;
+            }
+            if (!grown)
+                break;
+        }
+    }
+
+    // Abstand von (x, y) zum Start der letzten flood, -1 wenn unerreichbar
+    int local(int c, int x, int y) const {
+        return _local[(y - (c / _columns) * _cluster_size) * _cluster_size + (x - (c % _columns) * _cluster_size)];
+    }
+
+    // Geht von (x, y) absteigend zum Start der letzten flood, ohne (x, y)
+    void walk(int c, int x, int y, TilePath& out) const {
+        const int dx[4] = { 0, 0, -1, 1 };
+        const int dy[4] = { -1, 1, 0, 0 };
+        int x1, y1, x2, y2;
+        cluster_bounds(c, x1, y1, x2, y2);
+        for (int d = local(c, x, y); d > 0; d--) {
+            for (int k = 0; k < 4; k++) {
+                int nx = x + dx[k], ny = y + dy[k];
+                if (nx >= x1 && nx < x2 && ny >= y1 && ny < y2 && local(c, nx, ny) == d - 1) {
+                    x = nx;
+                    y = ny;
+                    break;
+                }
+            }
+            out.push_back(std::make_pair(x, y));
+        }
+    }
+
+    void connect(int c, int x, int y, std::vector<std::pair<int, int> >& edges) {
+        edges.clear();
+        flood(c, x, y);
+        const std::vector<int>& nodes = _cluster_nodes[c];
+        for (size_t i = 0; i < nodes.size(); i++) {
+            int d = local(c, _nodes[nodes[i]].x, _nodes[nodes[i]].y);
+            if (d >= 0)
+                edges.push_back(std::make_pair(nodes[i], d));
+        }
+    }
+
+    // A* auf dem abstrakten Graphen mit Start und Ziel als zusaetzliche
+    // Knoten; die Route ohne Start landet in _route
+    bool search(int x1, int y1, int x2, int y2) {
+        int start = static_cast<int>(_nodes.size()), goal = start + 1;
+        if (_visit.size() < _nodes.size() + 2) {
+            _visit.resize(_nodes.size() + 2, 0);
+            _cost.resize(_nodes.size() + 2);
+            _parent.resize(_nodes.size() + 2);
+        }
+        if (++_search == 0) { // Ueberlauf des Zaehlers
+            std::fill(_visit.begin(), _visit.end(), 0);
+            _search = 1;
+        }
+        typedef std::pair<int64_t, int> Entry; // (priority, Knoten)
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+        _visit[start] = _search;
+        _cost[start] = 0;
+        open.push(Entry(priority(0, std::abs(x2 - x1) + std::abs(y2 - y1)), start));
+        while (!open.empty()) {
+            Entry top = open.top();
+            open.pop();
+            int id = top.second;
+            if (id == goal)
+                break;
+            int x = id == start ? x1 : _nodes[id].x, y = id == start ? y1 : _nodes[id].y;
+            if (top.first != priority(_cost[id], std::abs(x2 - x) + std::abs(y2 - y)))
+                continue; // veralteter Eintrag
+            if (id == start) {
+                for (size_t i = 0; i < _start_edges.size(); i++)
+                    relax(id, _start_edges[i].first, _start_edges[i].second, x2, y2, goal, open);
+                continue;
+            }
+            const std::vector<Edge>& edges = _nodes[id].edges;
+            for (size_t i = 0; i < edges.size(); i++)
+                relax(id, edges[i].to, edges[i].cost, x2, y2, goal, open);
+            for (size_t i = 0; i < _goal_edges.size(); i++) {
+                if (_goal_edges[i].first == id)
+                    relax(id, goal, _goal_edges[i].second, x2, y2, goal, open);
+            }
+        }
+        if (_visit[goal] != _search)
+            return false;
+        _route.clear();
+        for (int id = goal; id != start; id = _parent[id])
+            _route.push_back(id);
+        std::reverse(_route.begin(), _route.end());
+        return true;
+    }
+
+    // Sortiert nach geschaetzten Gesamtkosten g + h, bei Gleichstand zuerst
+    // den Knoten naeher am Ziel. Ohne diese Regel oeffnet A* auf offenen
+    // Flaechen alle gleich guten Umwege.
+    static int64_t priority(int g, int h) {
+        return (static_cast<int64_t>(g + h) << 24) | h;
+    }
+
+    template <typename Queue>
+    void relax(int from, int to, int cost, int x2, int y2, int goal, Queue& open) {
+        int g = _cost[from] + cost;
+        if (_visit[to] == _search && _cost[to] <= g)
+            return;
+        _visit[to] = _search;
+        _cost[to] = g;
+        _parent[to] = from;
+        int h = to == goal ? 0 : std::abs(x2 - _nodes[to].x) + std::abs(y2 - _nodes[to].y);
+        open.push(std::make_pair(priority(g, h), to));
+    }
+
+    // Haengt den Weg von (x1, y1) nach (x2, y2) im Cluster c an, aus dem Cache
+    // oder per Breitensuche
+    void append_segment(int c, int x1, int y1, int x2, int y2, TilePath& path) {
+        int width = _grid->width();
+        uint64_t key = (static_cast<uint64_t>(y1 * width + x1) << 32) | static_cast<uint32_t>(y2 * width + x2);
+        auto found = _cache_index.find(key);
+        if (found != _cache_index.end()) {
+            _cache.splice(_cache.begin(), _cache, found->second);
+            path.insert(path.end(), found->second->tiles.begin(), found->second->tiles.end());
+            _cache_hits++;
+            return;
+        }
+        _cache_misses++;
+        Segment segment;
+        segment.key = key;
+        segment.cluster = c;
+        flood(c, x2, y2);
+        walk(c, x1, y1, segment.tiles);
+        path.insert(path.end(), segment.tiles.begin(), segment.tiles.end());
+        if (_cache_capacity == 0)
+            return;
+        _cache.push_front(segment);
+        _cache_index[key] = _cache.begin();
+        if (_cache.size() > _cache_capacity) {
+            _cache_index.erase(_cache.back().key);
+            _cache.pop_back();
+        }
+    }
+};
+
+#endif /* PATHFIND_H */
@@ -0,0 +1,249 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include "mcigraph.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+// Zeitgeber der Spiellogik als hierarchisches Timing Wheel. Die Zeit zaehlt
+// in Spielschritten, advance() rechnet einen Schritt weiter. Die Schritte
+// werden wie eine Zahl zur Basis slots gelesen, jede Stelle hat eine eigene
+// Ebene mit slots Faechern. Ein Zeitgeber haengt auf der Ebene der hoechsten
+// Stelle, in der sich seine Faelligkeit due vom aktuellen Schritt
+// unterscheidet, im Fach der Ziffer von due an dieser Stelle. Auf Ebene 0
+// liegen damit nur Zeitgeber der laufenden Umdrehung, advance() schaut dort
+// nur das Fach des neuen Schritts an, und alles darin ist faellig.
+//
+// Springt eine Stelle des Schritts weiter, werden die Zeitgeber aus dem Fach
+// der neuen Ziffer dieser Ebene eine Ebene tiefer (oder direkt in ihr Fach)
+// umgehaengt. Jeder Zeitgeber wird so hoechstens einmal pro Ebene angefasst:
+// Anlegen, Abbrechen und Verschieben sind O(1), tausende wartende Zeitgeber
+// kosten nichts, auch wenn sie viele Umdrehungen entfernt liegen.
+//
+// Faellige Zeitgeber werden nicht als Callback ausgefuehrt, sondern als
+// (kind, data) zurueckgegeben, in der Reihenfolge ihres Anlegens bzw.
+// letzten Verschiebens. Der Aufrufer verteilt sie selbst, damit bleibt der
+// Ablauf fuer Replays deterministisch.
+
+struct TimerId {
+    uint32_t index;
+    uint32_t generation;
+};
+
+const TimerId NO_TIMER = { 0xFFFFFFFF, 0 };
+
+struct TimerFired {
+    int kind;
+    uint64_t data;
+};
+
+class TimerWheel {
+private:
+    struct Node {
+        long due;
+        int kind;
+        uint64_t data;
+        uint64_t order; // Reihenfolge des Anlegens bzw. Verschiebens
+        int32_t slot; // Fach ueber alle Ebenen, level * slots + Ziffer
+        int32_t prev, next; // Liste des Fachs, -1 am Ende
+        uint32_t generation; // wird beim Freigeben erhoeht
+        bool active;
+    };
+    std::vector<Node> _nodes;
+    std::vector<int32_t> _free;
+    std::vector<int32_t> _head, _tail; // pro Fach aller Ebenen
+    std::vector<int32_t> _due; // faellige Eintraege des laufenden advance()
+    long _now;
+    long _mask;
+    int _bits; // Bits pro Ziffer, slots = 1 << _bits
+    int _levels;
+    uint64_t _order;
+    size_t _active;
+
+    // Haengt n nach seiner Faelligkeit relativ zum aktuellen Schritt ein.
+    // Die oberste Ebene nimmt auch alles auf, was noch weiter entfernt ist.
+    void link(int32_t n) {
+        long diff = _nodes[n].due ^ _now;
+        int level = 0;
+        while (level < _levels - 1 && (diff >> (_bits * (level + 1))) != 0)
+            level++;
+        int32_t slot = static_cast<int32_t>((level << _bits) + ((_nodes[n].due >> (_bits * level)) & _mask));
+        _nodes[n].slot = slot;
+        _nodes[n].prev = _tail[slot];
+        _nodes[n].next = -1;
+        if (_tail[slot] >= 0)
+            _nodes[_tail[slot]].next = n;
+        else
+            _head[slot] = n;
+        _tail[slot] = n;
+    }
+
+    void unlink(int32_t n) {
+        int32_t slot = _nodes[n].slot;
+        if (_nodes[n].prev >= 0)
+            _nodes[_nodes[n].prev].next = _nodes[n].next;
+        else
+            _head[slot] = _nodes[n].next;
+        if (_nodes[n].next >= 0)
+            _nodes[_nodes[n].next].prev = _nodes[n].prev;
+        else
+            _tail[slot] = _nodes[n].prev;
+    }
+
+    // Haengt alle Eintraege eines Fachs neu ein, relativ zum neuen Schritt
+    // landen sie auf einer tieferen Ebene
+    void cascade(int32_t slot) {
+        int32_t n = _head[slot];
+        _head[slot] = _tail[slot] = -1;
+        while (n >= 0) {
+            int32_t next = _nodes[n].next;
+            link(n);
+            n = next;
+        }
+    }
+
+    void release(int32_t n) {
+        _nodes[n].active = false;
+        _nodes[n].generation++;
+        _free.push_back(n);
+        _active--;
+    }
+
+    int32_t find(TimerId id) const {
+        if (id.index >= _nodes.size())
+            return -1;
+        const Node& node = _nodes[id.index];
+        return node.active && node.generation == id.generation ? static_cast<int32_t>(id.index) : -1;
+    }
+
+public:
+    // slots muss eine Zweierpotenz ab 2 sein, am besten groesser als die meisten
+    // Verzoegerungen. Es gibt so viele Ebenen, dass jede Verzoegerung eines
+    // int ohne erneutes Durchsehen faellig wird.
+    explicit TimerWheel(int slots = 256) : _now(0), _mask(slots - 1), _bits(0), _order(0), _active(0) {
+        while ((1 << _bits) < slots)
+            _bits++;
+        _levels = (32 + _bits - 1) / _bits;
+        _head.assign(_levels << _bits, -1);
+        _tail.assign(_levels << _bits, -1);
+    }
+
+    // Aktueller Spielschritt
+    long now() const {
+        return _now;
+    }
+
+    // Anzahl wartender Zeitgeber
+    size_t size() const {
+        return _active;
+    }
+
+    // Zeitgeber, der delay >= 1 Schritte nach dem aktuellen faellig wird
+    TimerId schedule(int delay, int kind, uint64_t data = 0) {
+        int32_t n;
+        if (_free.size() > 0) {
+            n = _free.back();
+            _free.pop_back();
+        }
+        else {
+            n = static_cast<int32_t>(_nodes.size());
+            _nodes.push_back(Node());
+            _nodes[n].generation = 0;
+        }
+        Node& node = _nodes[n];
+        node.due = _now + (delay < 1 ? 1 : delay);
+        node.kind = kind;
+        node.data = data;
+        node.active = true;
+        node.order = _order++;
+        link(n);
+        _active++;
+        TimerId id = { static_cast<uint32_t>(n), node.generation };
+        return id;
+    }
+
+    // false fuer abgebrochene, bereits ausgeloeste und NO_TIMER
+    bool pending(TimerId id) const {
+        return find(id) >= 0;
+    }
+
+    // Schritte bis zur Faelligkeit, 0 wenn der Zeitgeber nicht wartet
+    int remaining(TimerId id) const {
+        int32_t n = find(id);
+        return n >= 0 ? static_cast<int>(_nodes[n].due - _now) : 0;
+    }
+
+    bool cancel(TimerId id) {
+        int32_t n = find(id);
+        if (n < 0)
+            return false;
+        unlink(n);
+        release(n);
+        return true;
+    }
+
+    // Neue Faelligkeit delay >= 1 Schritte nach dem aktuellen, die Id bleibt gueltig
+    bool reschedule(TimerId id, int delay) {
+        int32_t n = find(id);
+        if (n < 0)
+            return false;
+        unlink(n);
+        _nodes[n].due = _now + (delay < 1 ? 1 : delay);
+        _nodes[n].order = _order++;
+        link(n);
+        return true;
+    }
+
+    // Geht einen Schritt weiter und haengt alle jetzt faelligen Zeitgeber an
+    // fired an, ihre Ids sind danach ungueltig
+    void advance(std::vector<TimerFired>& fired) {
+        _now++;
+        // Hoehere Stellen zuerst, was dabei nach unten rutscht, wird auf der
+        // naechsten Ebene gleich mit verteilt
+        int level = 0;
+        while (level < _levels - 1 && ((_now >> (_bits * (level + 1))) << (_bits * (level + 1))) == _now)
+            level++;
+        for (; level > 0; level--)
+            cascade(static_cast<int32_t>((level << _bits) + ((_now >> (_bits * level)) & _mask)));
+
+        // Im Fach von Ebene 0 ist jetzt alles faellig. Durch das Umhaengen
+        // kann die Liste aus der Reihenfolge geraten, daher sortieren.
+        int32_t slot = static_cast<int32_t>(_now & _mask);
+        _due.clear();
+        for (int32_t n = _head[slot]; n >= 0; n = _nodes[n].next)
+            _due.push_back(n);
+        _head[slot] = _tail[slot] = -1;
+        const std::vector<Node>& nodes = _nodes;
+        std::sort(_due.begin(), _due.end(), [&nodes](int32_t a, int32_t b) { return nodes[a].order < nodes[b].order; });
+        for (int32_t n : _due) {
+            TimerFired timer = { _nodes[n].kind, _nodes[n].data };
+            fired.push_back(timer);
+            release(n);
+        }
+    }
+
+    void clear() {
+        for (size_t n = 0; n < _nodes.size(); n++) {
+            if (_nodes[n].active)
+                release(static_cast<int32_t>(n));
+        }
+        std::fill(_head.begin(), _head.end(), -1);
+        std::fill(_tail.begin(), _tail.end(), -1);
+    }
+
+    uint64_t hash(uint64_t h) const {
+        h = mcigraph::hash_state(h, _now);
+        for (size_t n = 0; n < _nodes.size(); n++) {
+            if (!_nodes[n].active)
+                continue;
+            h = mcigraph::hash_state(h, _nodes[n].due);
+            h = mcigraph::hash_state(h, _nodes[n].kind);
+            h = mcigraph::hash_state(h, _nodes[n].data);
+        }
+        return h;
+    }
+};
+
+#endif /* TIMERS_H */
@@ -0,0 +1,35 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "mcijobs.hpp"
+#include <functional>
+
+// Einfacher Thread-Pool: run(count, job) ruft job(i) fuer alle i < count auf,
+// verteilt auf die Threads und den aufrufenden Thread, und wartet auf das Ende.
+// Laeuft auf dem JobSystem der Bibliothek, das ueber jobs() auch direkt fuer
+// parallel_for und Jobs mit Abhaengigkeiten benutzt werden kann.
+class WorkerPool {
+private:
+    mcigraph::JobSystem _jobs;
+
+public:
+    WorkerPool(int threads) : _jobs(threads) {}
+
+    int size() {
+        return _jobs.size();
+    }
+
+    mcigraph::JobSystem& jobs() {
+        return _jobs;
+    }
+
+    void run(int count, std::function<void(int)> job) {
+        _jobs.parallel_for(0, count, 1, [&](int, int first, int) { job(first); });
+    }
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif /* WORKERS_H */
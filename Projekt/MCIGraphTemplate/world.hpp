@@ -0,0 +1,851 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "mcigraph.hpp"
+#include "mcijobs.hpp"
+#include "map.hpp"
+#include "collision.hpp"
+#include "pathfind.hpp"
+#include "events.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WORLD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Datenorientierte Speicherung der Monster, Objekte und Baelle. Statt eines
+// vector<Monster> mit einem string pro Figur liegen Position, Lebenspunkte,
+// Flags und Sprite jeweils in einem eigenen zusammenhaengenden Array. Die
+// Systeme weiter unten (Bewegung, Schuesse, Zeichnen) laufen
+// linear ueber diese Arrays.
+//
+// Von aussen werden Entitaeten ueber Handles mit Generationszaehler
+// angesprochen, ein Handle einer geloeschten Entitaet wird als ungueltig
+// erkannt. Geloescht wird verzoegert: destroy() merkt den Eintrag nur vor,
+// flush() am Ende des Ticks entfernt alle vorgemerkten Eintraege durch
+// Vertauschen mit dem letzten Eintrag (swap-and-pop) in O(1) pro Eintrag.
+//
+// Jeder EntityStore fuehrt zusaetzlich ein SpatialGrid, das bei jeder
+// Positionsaenderung mitgefuehrt wird. Kollisionsabfragen (entities_at,
+// query_rect) kosten damit nur so viel wie Entitaeten in der Naehe stehen.
+
+// Bilder der Entitaeten, der Index ist die Sprite-ID
+enum Sprite {
+    SPRITE_MONSTER,
+    SPRITE_FIRE,
+    SPRITE_GOLD,
+    SPRITE_CLOCK,
+    SPRITE_DOOR,
+    SPRITE_BALL1,
+    SPRITE_BALL2,
+    SPRITE_COUNT
+};
+
+const char* const SPRITE_FILES[SPRITE_COUNT] = {
+    "monster.bmp", "fire.bmp", "gold.bmp", "clock.bmp", "door.bmp", "ball1.bmp", "ball2.bmp"
+};
+
+// Bilder der Figuren (Spieler und Waffe), die ebenfalls eine Maske brauchen
+const char* const FIGURE_FILES[] = { "char1.bmp", "gun.bmp" };
+const int FIGURE_COUNT = sizeof(FIGURE_FILES) / sizeof(FIGURE_FILES[0]);
+
+// Kollisionsmasken aller Bilder der Spiellogik (Magenta ist durchsichtig),
+// zuerst die Sprites in der Reihenfolge der Sprite-IDs, dann die Figuren.
+// Die Masken kommen aus einem eigenen Cache ohne Renderer, damit die
+// Spiellogik auch ohne Fenster pixelgenau rechnet. Fehlt eine Datei, gilt
+// die ganze Kachel.
+//
+// Die Tabelle wird beim ersten Aufruf von sprite_masks() einmal vollstaendig
+// gebaut und danach nur noch gelesen. Ab C++11 initialisiert genau ein Thread
+// eine statische Variable, alle anderen warten darauf; zudem holt sich schon
+// der Konstruktor von Game ueber die Figuren die Tabelle, also bevor GameEnv
+// Spiele parallel rechnet.
+class SpriteMasks {
+private:
+    std::vector<mcigraph::CollisionMask> _masks;
+
+    static const char* file(int i) {
+        return i < SPRITE_COUNT ? SPRITE_FILES[i] : FIGURE_FILES[i - SPRITE_COUNT];
+    }
+
+public:
+    SpriteMasks() {
+        mcigraph::TextureLoadCache cache;
+        for (int i = 0; i < SPRITE_COUNT + FIGURE_COUNT; i++) {
+            FILE* f = fopen(file(i), "rb"); // nur hier beim Aufbau der Tabelle
+            if (f == NULL) {
+                _masks.push_back(mcigraph::CollisionMask(16, 16, true));
+                continue;
+            }
+            fclose(f);
+            _masks.push_back(cache.mask(file(i)));
+        }
+    }
+
+    const mcigraph::CollisionMask& sprite(int sprite) const {
+        return _masks[sprite];
+    }
+
+    // Maske einer Bilddatei aus SPRITE_FILES oder FIGURE_FILES
+    const mcigraph::CollisionMask& image(const std::string& filename) const {
+        for (int i = 0; i < SPRITE_COUNT + FIGURE_COUNT; i++) {
+            if (filename == file(i))
+                return _masks[i];
+        }
+        throw mcigraph::MciGraphException("No collision mask for image: " + filename);
+    }
+};
+
+inline const SpriteMasks& sprite_masks() {
+    static const SpriteMasks masks;
+    return masks;
+}
+
+inline const mcigraph::CollisionMask& sprite_mask(const std::string& file) {
+    return sprite_masks().image(file);
+}
+
+inline const mcigraph::CollisionMask& sprite_mask(int sprite) {
+    return sprite_masks().sprite(sprite);
+}
+
+// Bits in EntityStore::flags
+enum EntityFlag {
+    FLAG_DEAD = 1,        // Monster tot bzw. Ball fertig abgeschossen
+    FLAG_COLLECTABLE = 2, // Objekt kann aufgesammelt werden
+    FLAG_RANGE = 4,       // Objekt erhoeht die Reichweite (Gold)
+    FLAG_CLOCK = 8,       // Objekt verkuerzt die Verzoegerung (Uhr)
+    FLAG_RIGHT = 16,      // Ball fliegt nach rechts (sonst links)
+    FLAG_DOWN = 32,       // Ball fliegt nach unten (sonst oben)
+    FLAG_DESTROYED = 64   // zum Loeschen am Ende des Ticks vorgemerkt
+};
+
+// Schrittweite einer Richtung
+inline void direction_step(int direction, int& dx, int& dy) {
+    dx = direction == DIR_LEFT ? -1 : direction == DIR_RIGHT ? 1 : 0;
+    dy = direction == DIR_UP ? -1 : direction == DIR_DOWN ? 1 : 0;
+}
+
+// Bewegt eine Position um eine Kachel, wenn die Zielkachel frei ist
+inline void move_tile(int16_t& x, int16_t& y, int direction, const CollisionGrid& stop) {
+    int dx, dy;
+    direction_step(direction, dx, dy);
+    if (!stop.blocked(x + dx, y + dy)) {
+        x = static_cast<int16_t>(x + dx);
+        y = static_cast<int16_t>(y + dy);
+    }
+}
+
+// Verweis auf eine Entitaet, bleibt anders als der Index auch nach dem
+// Loeschen anderer Entitaeten gueltig
+struct Handle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+const Handle NO_HANDLE = { 0xFFFFFFFF, 0 };
+
+// Gleichmaessiges Gitter ueber das Spielfeld. Jede Zelle (cell_size x cell_size
+// Kacheln) haelt eine doppelt verkettete Liste der Slots, die darin stehen, so
+// dass Einfuegen, Entfernen und Verschieben O(1) sind.
+class SpatialGrid {
+private:
+    int _width, _height, _cell_size, _columns, _rows;
+    std::vector<int32_t> _head; // erster Slot pro Zelle, -1 wenn leer
+    std::vector<int32_t> _next; // pro Slot: naechster Slot in derselben Zelle
+    std::vector<int32_t> _prev; // pro Slot: vorheriger Slot in derselben Zelle
+    std::vector<int32_t> _cell; // pro Slot: Zelle, -1 wenn nicht eingetragen
+
+public:
+    SpatialGrid(int width = 64, int height = 48, int cell_size = 1)
+        : _width(width), _height(height), _cell_size(cell_size),
+          _columns((width + cell_size - 1) / cell_size), _rows((height + cell_size - 1) / cell_size),
+          _head(_columns * _rows, -1) {}
+
+    int columns() const {
+        return _columns;
+    }
+    int rows() const {
+        return _rows;
+    }
+    int cell_size() const {
+        return _cell_size;
+    }
+
+    // Zelle der Kachel (x, y), Positionen ausserhalb werden an den Rand gelegt
+    int cell(int x, int y) const {
+        x = x < 0 ? 0 : x >= _width ? _width - 1 : x;
+        y = y < 0 ? 0 : y >= _height ? _height - 1 : y;
+        return (y / _cell_size) * _columns + x / _cell_size;
+    }
+
+    int32_t head(int cell) const {
+        return _head[cell];
+    }
+    int32_t next(uint32_t slot) const {
+        return _next[slot];
+    }
+
+    void insert(uint32_t slot, int x, int y) {
+        if (slot >= _cell.size()) {
+            _next.resize(slot + 1, -1);
+            _prev.resize(slot + 1, -1);
+            _cell.resize(slot + 1, -1);
+        }
+        int c = cell(x, y);
+        _cell[slot] = c;
+        _prev[slot] = -1;
+        _next[slot] = _head[c];
+        if (_head[c] >= 0)
+            _prev[_head[c]] = slot;
+        _head[c] = slot;
+    }
+
+    void remove(uint32_t slot) {
+        int c = _cell[slot];
+        if (c < 0)
+            return;
+        if (_prev[slot] >= 0)
+            _next[_prev[slot]] = _next[slot];
+        else
+            _head[c] = _next[slot];
+        if (_next[slot] >= 0)
+            _prev[_next[slot]] = _prev[slot];
+        _cell[slot] = -1;
+    }
+
+    // Traegt den Slot nur um, wenn er die Zelle wechselt
+    void move(uint32_t slot, int x, int y) {
+        if (cell(x, y) == _cell[slot])
+            return;
+        remove(slot);
+        insert(slot, x, y);
+    }
+
+    void clear() {
+        std::fill(_head.begin(), _head.end(), -1);
+        std::fill(_cell.begin(), _cell.end(), -1);
+    }
+};
+
+// Alle Entitaeten einer Art, ein Eintrag pro Index in jedem Array
+class EntityStore {
+private:
+    struct Slot {
+        uint32_t index;      // aktueller Index in den Arrays
+        uint32_t generation; // wird beim Loeschen erhoeht
+    };
+    std::vector<Slot> _slots;       // Handle.slot -> Index
+    std::vector<uint32_t> _slot_of; // Index -> Handle.slot
+    std::vector<uint32_t> _free;    // unbenutzte Slots
+    std::vector<uint32_t> _pending; // zum Loeschen vorgemerkte Indizes
+    SpatialGrid _grid;              // Slots nach Position
+    uint32_t _population[SPRITE_COUNT] = {}; // nicht vorgemerkte Eintraege je Sprite
+
+public:
+    // Nur lesen, Positionen werden ueber set_position() geaendert
+    std::vector<int16_t> x, y;
+    std::vector<int16_t> health;  // Lebenspunkte (Monster) bzw. noetige Treffer (Ball)
+    std::vector<uint8_t> flags;   // EntityFlag
+    std::vector<uint8_t> sprite;  // Sprite
+
+    // Alle Eintraege auf einer Kachel, als for (size_t i : store.entities_at(x, y))
+    class TileRange {
+    private:
+        const EntityStore* _store;
+        int _x, _y;
+
+    public:
+        class iterator {
+        private:
+            const EntityStore* _store;
+            int32_t _slot;
+            int _x, _y;
+
+            void skip() { // Zellen koennen mehrere Kacheln umfassen
+                while (_slot >= 0 && !_store->on_tile(_slot, _x, _y))
+                    _slot = _store->_grid.next(_slot);
+            }
+
+        public:
+            iterator(const EntityStore* store, int32_t slot, int x, int y) : _store(store), _slot(slot), _x(x), _y(y) {
+                skip();
+            }
+            size_t operator*() const {
+                return _store->_slots[_slot].index;
+            }
+            iterator& operator++() {
+                _slot = _store->_grid.next(_slot);
+                skip();
+                return *this;
+            }
+            bool operator!=(const iterator& other) const {
+                return _slot != other._slot;
+            }
+        };
+
+        TileRange(const EntityStore* store, int x, int y) : _store(store), _x(x), _y(y) {}
+
+        iterator begin() const {
+            return iterator(_store, _store->_grid.head(_store->_grid.cell(_x, _y)), _x, _y);
+        }
+        iterator end() const {
+            return iterator(_store, -1, _x, _y);
+        }
+    };
+
+    EntityStore(int width = 64, int height = 48, int cell_size = 1) : _grid(width, height, cell_size) {}
+
+    size_t size() const {
+        return x.size();
+    }
+
+    // Anzahl der Entitaeten, die nicht zum Loeschen vorgemerkt sind
+    size_t live() const {
+        return size() - _pending.size();
+    }
+
+    // Anzahl der nicht vorgemerkten Entitaeten mit diesem Sprite, in O(1)
+    size_t live(Sprite image) const {
+        return _population[image];
+    }
+
+    // Neue Entitaet an einer zufaelligen Position, wie Figure(string)
+    Handle spawn(Sprite image, int hp, int entity_flags, Rng& rng) {
+        int px = rng.bounded(64);
+        int py = rng.bounded(48);
+        return spawn_at(image, px, py, hp, entity_flags);
+    }
+
+    Handle spawn_at(Sprite image, int px, int py, int hp, int entity_flags) {
+        uint32_t slot;
+        if (_free.size() > 0) {
+            slot = _free.back();
+            _free.pop_back();
+        }
+        else {
+            slot = static_cast<uint32_t>(_slots.size());
+            _slots.push_back(Slot{ 0, 0 });
+        }
+        _slots[slot].index = static_cast<uint32_t>(size());
+        _slot_of.push_back(slot);
+        x.push_back(static_cast<int16_t>(px));
+        y.push_back(static_cast<int16_t>(py));
+        health.push_back(static_cast<int16_t>(hp));
+        flags.push_back(static_cast<uint8_t>(entity_flags));
+        sprite.push_back(static_cast<uint8_t>(image));
+        _population[image]++;
+        _grid.insert(slot, px, py);
+        Handle handle = { slot, _slots[slot].generation };
+        return handle;
+    }
+
+    void set_position(size_t i, int px, int py) {
+        x[i] = static_cast<int16_t>(px);
+        y[i] = static_cast<int16_t>(py);
+        _grid.move(_slot_of[i], px, py);
+    }
+
+    TileRange entities_at(int px, int py) const {
+        return TileRange(this, px, py);
+    }
+
+    // Haengt die Indizes aller Eintraege im Rechteck (x1, y1)-(x2, y2), Raender
+    // eingeschlossen, an out an und gibt ihre Anzahl zurueck
+    size_t query_rect(int x1, int y1, int x2, int y2, std::vector<size_t>& out) const {
+        size_t count = 0;
+        int c1 = _grid.cell(x1, y1);
+        int c2 = _grid.cell(x2, y2);
+        for (int row = c1 / _grid.columns(); row <= c2 / _grid.columns(); row++) {
+            for (int column = c1 % _grid.columns(); column <= c2 % _grid.columns(); column++) {
+                for (int32_t slot = _grid.head(row * _grid.columns() + column); slot >= 0; slot = _grid.next(slot)) {
+                    size_t i = _slots[slot].index;
+                    if (x[i] >= x1 && x[i] <= x2 && y[i] >= y1 && y[i] <= y2) {
+                        out.push_back(i);
+                        count++;
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    Handle handle(size_t i) const {
+        Handle h = { _slot_of[i], _slots[_slot_of[i]].generation };
+        return h;
+    }
+
+    // false fuer Handles bereits geloeschter Entitaeten
+    bool alive(Handle h) const {
+        return h.slot < _slots.size() && _slots[h.slot].generation == h.generation;
+    }
+
+    // Index der Entitaet oder -1, wenn das Handle ungueltig ist
+    long index_of(Handle h) const {
+        return alive(h) ? static_cast<long>(_slots[h.slot].index) : -1;
+    }
+
+    // Merkt Eintrag i zum Loeschen am Ende des Ticks vor
+    void destroy(size_t i) {
+        if (flags[i] & FLAG_DESTROYED)
+            return;
+        flags[i] |= FLAG_DESTROYED;
+        _population[sprite[i]]--;
+        _pending.push_back(static_cast<uint32_t>(i));
+    }
+
+    void destroy(Handle h) {
+        long i = index_of(h);
+        if (i >= 0)
+            destroy(i);
+    }
+
+    // Entfernt alle vorgemerkten Eintraege, von hinten nach vorne, damit der
+    // jeweils letzte Eintrag nie selbst vorgemerkt ist
+    void flush() {
+        std::sort(_pending.begin(), _pending.end(), std::greater<uint32_t>());
+        for (uint32_t i : _pending)
+            swap_and_pop(i);
+        _pending.clear();
+    }
+
+    // Loescht sofort alle Eintraege, alle Handles werden ungueltig
+    void clear() {
+        while (size() > 0)
+            swap_and_pop(size() - 1);
+        _pending.clear();
+        _grid.clear();
+    }
+
+    uint64_t hash(uint64_t h) const {
+        for (size_t i = 0; i < size(); i++) {
+            h = mcigraph::hash_state(h, x[i]);
+            h = mcigraph::hash_state(h, y[i]);
+            h = mcigraph::hash_state(h, health[i]);
+            h = mcigraph::hash_state(h, flags[i]);
+        }
+        return h;
+    }
+
+private:
+    bool on_tile(uint32_t slot, int px, int py) const {
+        size_t i = _slots[slot].index;
+        return x[i] == px && y[i] == py;
+    }
+
+    void swap_and_pop(size_t i) {
+        if ((flags[i] & FLAG_DESTROYED) == 0) // clear() ohne vorheriges destroy()
+            _population[sprite[i]]--;
+        size_t last = size() - 1;
+        uint32_t slot = _slot_of[i];
+        _grid.remove(slot);
+        _slots[slot].generation++;
+        _free.push_back(slot);
+        if (i != last) {
+            x[i] = x[last];
+            y[i] = y[last];
+            health[i] = health[last];
+            flags[i] = flags[last];
+            sprite[i] = sprite[last];
+            _slot_of[i] = _slot_of[last];
+            _slots[_slot_of[i]].index = static_cast<uint32_t>(i);
+        }
+        x.pop_back();
+        y.pop_back();
+        health.pop_back();
+        flags.pop_back();
+        sprite.pop_back();
+        _slot_of.pop_back();
+    }
+};
+
+// Obergrenze und Lebensdauer je Sprite. cap begrenzt die gleichzeitig
+// lebenden Entitaeten, lifetime ist die Anzahl Spielschritte bis zum
+// Verschwinden, 0 heisst jeweils unbegrenzt.
+struct Population {
+    int cap;
+    int lifetime;
+};
+
+const Population POPULATION[SPRITE_COUNT] = {
+    { 0, 0 },   // SPRITE_MONSTER, die Anzahl begrenzt Game::amount_monsters
+    { 6, 200 }, // SPRITE_FIRE, 20 Sekunden
+    { 6, 300 }, // SPRITE_GOLD, 30 Sekunden
+    { 6, 300 }, // SPRITE_CLOCK
+    { 0, 0 },   // SPRITE_DOOR
+    { 0, 0 },   // SPRITE_BALL1
+    { 0, 0 }    // SPRITE_BALL2
+};
+
+// Spawnen mit Gegendruck: hat das Sprite seine Obergrenze erreicht, entsteht
+// nichts, der Zufallsgenerator wird nicht benutzt und das Ergebnis ist NO_HANDLE
+inline Handle spawn_limited(EntityStore& store, Sprite image, int hp, int entity_flags, Rng& rng) {
+    int cap = POPULATION[image].cap;
+    if (cap > 0 && store.live(image) >= static_cast<size_t>(cap))
+        return NO_HANDLE;
+    return store.spawn(image, hp, entity_flags, rng);
+}
+
+// Ab dieser Anzahl Entitaeten rechnen die Bewegungssysteme mit jobs parallel,
+// in Bloecken dieser Groesse
+const int PARALLEL_GRAIN = 4096;
+
+// Neue Position einer Entitaet, gesammelt in einem Puffer pro Block
+struct EntityMove {
+    uint32_t index;
+    int16_t x, y;
+};
+
+// Gemeinsamer Rahmen der Bewegungssysteme: step(i, x, y) berechnet die neue
+// Position von Entitaet i und darf ausser x und y nur Daten von i aendern
+// (z.B. flags[i]). Mit jobs laufen die Bloecke parallel und schreiben in
+// eigene Puffer; die Positionen werden danach in Blockreihenfolge in den
+// Store uebernommen, also genau in der Reihenfolge des seriellen Durchlaufs.
+template <typename Step>
+void move_entities(EntityStore& store, Step step, mcigraph::JobSystem* jobs) {
+    int count = static_cast<int>(store.size());
+    if (jobs == NULL || count < PARALLEL_GRAIN) {
+        for (int i = 0; i < count; i++) {
+            int16_t x = store.x[i];
+            int16_t y = store.y[i];
+            step(i, x, y);
+            store.set_position(i, x, y);
+        }
+        return;
+    }
+    std::vector<std::vector<EntityMove> > moves(mcigraph::JobSystem::chunk_count(0, count, PARALLEL_GRAIN));
+    jobs->parallel_for(0, count, PARALLEL_GRAIN, [&](int chunk, int first, int last) {
+        std::vector<EntityMove>& out = moves[chunk];
+        for (int i = first; i < last; i++) {
+            int16_t x = store.x[i];
+            int16_t y = store.y[i];
+            step(i, x, y);
+            if (x != store.x[i] || y != store.y[i]) {
+                EntityMove move = { static_cast<uint32_t>(i), x, y };
+                out.push_back(move);
+            }
+        }
+    });
+    for (size_t c = 0; c < moves.size(); c++) {
+        for (const EntityMove& move : moves[c])
+            store.set_position(move.index, move.x, move.y);
+    }
+}
+
+// Bewegungssystem der Monster: Entitaet i geht in Richtung directions[i], die
+// Richtungen kommen gesammelt aus DirectionFill
+inline void move_random(EntityStore& store, const CollisionGrid& stop, const uint8_t* directions,
+                        mcigraph::JobSystem* jobs = NULL) {
+    move_entities(store, [&](int i, int16_t& x, int16_t& y) { move_tile(x, y, directions[i], stop); }, jobs);
+}
+
+// Bewegungssystem verfolgender Monster: wer hoechstens range Schritte vom
+// Ziel des Flussfelds entfernt ist, liest seinen Schritt aus dem Feld,
+// alle anderen gehen in die zufaellige Richtung directions[i]. Mit
+// even_odd wird abwechselnd jedes zweite Monster zufaellig bewegt, damit die
+// Verfolger nicht in einer Reihe laufen.
+inline void move_chasing(EntityStore& store, const CollisionGrid& stop, const FlowField& flow, int range,
+                         const uint8_t* directions, int even_odd, mcigraph::JobSystem* jobs = NULL) {
+    move_entities(store, [&](int i, int16_t& x, int16_t& y) {
+        int direction = directions[i];
+        if ((i + even_odd) % 2 == 0 && flow.distance(x, y) <= range && flow.direction(x, y) != DIR_NONE)
+            direction = flow.direction(x, y);
+        move_tile(x, y, direction, stop);
+    }, jobs);
+}
+
+// Ein Schritt eines Balls: erst waagrecht, dann senkrecht, jeweils nur auf
+// freie Kacheln. An x == 0 / max_x und y == 0 / max_y kehrt die Richtung um.
+inline void bounce_one(int16_t& x, int16_t& y, uint8_t& flags, const CollisionGrid& stop, int max_x, int max_y) {
+    move_tile(x, y, (flags & FLAG_RIGHT) ? DIR_RIGHT : DIR_LEFT, stop);
+    if (x == max_x)
+        flags &= ~FLAG_RIGHT;
+    if (x == 0)
+        flags |= FLAG_RIGHT;
+
+    move_tile(x, y, (flags & FLAG_DOWN) ? DIR_DOWN : DIR_UP, stop);
+    if (y == max_y)
+        flags &= ~FLAG_DOWN;
+    if (y == 0)
+        flags |= FLAG_DOWN;
+}
+
+// true, wenn im Bereich der Baelle keine Kachel blockiert ist; dann braucht
+// bounce_batch nur die Grenzen des Felds zu pruefen
+inline bool bounce_area_free(const CollisionGrid& stop, int max_y) {
+    for (int y = 0; y <= max_y && y < stop.height(); y++) {
+        if (!stop.row_clear(0, stop.width() - 1, y))
+            return false;
+    }
+    return true;
+}
+
+// bounce_one fuer die Baelle first bis last - 1 der SoA-Arrays. Mit SSE2
+// laufen je 8 Baelle gemeinsam; die Richtung steckt wie bei bounce_one in
+// FLAG_RIGHT und FLAG_DOWN. Ist area_free false, wird pro Ball und Achse ein
+// Bit im CollisionGrid gelesen, sonst nur gegen den Rand des Felds geprueft.
+inline void bounce_batch(int16_t* xs, int16_t* ys, uint8_t* flags, size_t first, size_t last,
+                         const CollisionGrid& stop, int max_x, int max_y, bool area_free) {
+    size_t i = first;
+#ifdef WORLD_SSE2
+    const __m128i one = _mm_set1_epi16(1), two = _mm_set1_epi16(2), zero = _mm_setzero_si128();
+    const __m128i right_bit = _mm_set1_epi16(FLAG_RIGHT), down_bit = _mm_set1_epi16(FLAG_DOWN);
+    const __m128i edge_x = _mm_set1_epi16(static_cast<int16_t>(max_x)), edge_y = _mm_set1_epi16(static_cast<int16_t>(max_y));
+    const __m128i width = _mm_set1_epi16(static_cast<int16_t>(stop.width() - 1));
+    const __m128i height = _mm_set1_epi16(static_cast<int16_t>(stop.height() - 1));
+    for (; i + 8 <= last; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ys + i));
+        __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(flags + i)), zero);
+        __m128i right = _mm_cmpeq_epi16(_mm_and_si128(f, right_bit), right_bit);
+        __m128i down = _mm_cmpeq_epi16(_mm_and_si128(f, down_bit), down_bit);
+
+        // waagrecht: dx = +1 / -1, blockiert ausserhalb des Felds oder auf einer Wand
+        __m128i dx = _mm_sub_epi16(_mm_and_si128(right, two), one);
+        __m128i nx = _mm_add_epi16(x, dx);
+        __m128i blocked = _mm_or_si128(_mm_cmplt_epi16(nx, zero), _mm_cmpgt_epi16(nx, width));
+        if (!area_free) {
+            alignas(16) int16_t tx[8], ty[8], wall[8];
+            _mm_store_si128(reinterpret_cast<__m128i*>(tx), nx);
+            _mm_store_si128(reinterpret_cast<__m128i*>(ty), y);
+            for (int l = 0; l < 8; l++)
+                wall[l] = stop.blocked(tx[l], ty[l]) ? -1 : 0;
+            blocked = _mm_or_si128(blocked, _mm_load_si128(reinterpret_cast<const __m128i*>(wall)));
+        }
+        x = _mm_add_epi16(x, _mm_andnot_si128(blocked, dx));
+        right = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi16(x, edge_x), right), _mm_cmpeq_epi16(x, zero));
+
+        // senkrecht mit der neuen x-Position
+        __m128i dy = _mm_sub_epi16(_mm_and_si128(down, two), one);
+        __m128i ny = _mm_add_epi16(y, dy);
+        blocked = _mm_or_si128(_mm_cmplt_epi16(ny, zero), _mm_cmpgt_epi16(ny, height));
+        if (!area_free) {
+            alignas(16) int16_t tx[8], ty[8], wall[8];
+            _mm_store_si128(reinterpret_cast<__m128i*>(tx), x);
+            _mm_store_si128(reinterpret_cast<__m128i*>(ty), ny);
+            for (int l = 0; l < 8; l++)
+                wall[l] = stop.blocked(tx[l], ty[l]) ? -1 : 0;
+            blocked = _mm_or_si128(blocked, _mm_load_si128(reinterpret_cast<const __m128i*>(wall)));
+        }
+        y = _mm_add_epi16(y, _mm_andnot_si128(blocked, dy));
+        down = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi16(y, edge_y), down), _mm_cmpeq_epi16(y, zero));
+
+        f = _mm_andnot_si128(_mm_or_si128(right_bit, down_bit), f);
+        f = _mm_or_si128(f, _mm_or_si128(_mm_and_si128(right, right_bit), _mm_and_si128(down, down_bit)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(xs + i), x);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ys + i), y);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(flags + i), _mm_packus_epi16(f, zero));
+    }
+#else
+    (void)area_free;
+#endif
+    for (; i < last; i++)
+        bounce_one(xs[i], ys[i], flags[i], stop, max_x, max_y);
+}
+
+// Bewegungssystem der Baelle: fliegen diagonal und prallen am Rand ab, die
+// unterste Zeile ist max_y. Die Positionen werden stapelweise mit
+// bounce_batch gerechnet (mit jobs in Bloecken parallel) und danach in
+// Indexreihenfolge in das raeumliche Gitter des Stores uebernommen.
+inline void move_bouncing(EntityStore& store, const CollisionGrid& stop, mcigraph::JobSystem* jobs = NULL,
+                          int max_y = 43) {
+    int count = static_cast<int>(store.size());
+    if (count == 0)
+        return;
+    int max_x = stop.width() - 1;
+    bool area_free = bounce_area_free(stop, max_y);
+    int16_t* xs = store.x.data();
+    int16_t* ys = store.y.data();
+    uint8_t* flags = store.flags.data();
+    if (jobs == NULL || count < PARALLEL_GRAIN) {
+        bounce_batch(xs, ys, flags, 0, count, stop, max_x, max_y, area_free);
+    }
+    else {
+        jobs->parallel_for(0, count, PARALLEL_GRAIN, [&](int, int first, int last) {
+            bounce_batch(xs, ys, flags, first, last, stop, max_x, max_y, area_free);
+        });
+    }
+    for (int i = 0; i < count; i++)
+        store.set_position(i, xs[i], ys[i]);
+}
+
+// Treffer eines Strahls: Eintrag index in layers[layer], distance Kacheln vom Ursprung
+struct RayHit {
+    int layer;
+    size_t index;
+    int distance;
+};
+
+// Ergebnis von raycast(), wird wiederverwendet, damit pro Schuss nichts allokiert wird
+struct Ray {
+    int x, y;           // letzte Kachel, die der Strahl erreicht hat
+    int length;         // Anzahl der durchlaufenen Kacheln
+    bool blocked;       // true, wenn der Strahl vor max_range an eine Wand oder den Rand stoesst
+    int wall_x, wall_y; // die blockierende Kachel (kann ausserhalb des Spielfelds liegen)
+    std::vector<RayHit> hits; // getroffene Entitaeten in Flugreihenfolge
+};
+
+// Verfolgt einen Strahl von (x, y) aus Kachel fuer Kachel in direction, bis
+// max_range erreicht ist oder die naechste Kachel in stop blockiert oder
+// ausserhalb ist. Die freie Strecke liefert CollisionGrid::free_run. Auf jeder erreichten Kachel werden ueber den Raumindex die
+// Entitaeten aller Ebenen layers[i] gesammelt, deren Bit i in mask gesetzt
+// ist. Die Kosten haengen nur von der Laenge und den Treffern ab, nicht von
+// der Gesamtzahl der Entitaeten.
+inline void raycast(int x, int y, int direction, int max_range, const CollisionGrid& stop,
+                    EntityStore* const* layers, int layer_count, unsigned int mask, Ray& ray) {
+    int dx, dy;
+    direction_step(direction, dx, dy);
+    ray.x = x;
+    ray.y = y;
+    ray.length = 0;
+    ray.blocked = false;
+    ray.hits.clear();
+    int run = stop.free_run(x, y, direction, max_range);
+    if (run < max_range) {
+        ray.blocked = true;
+        ray.wall_x = x + dx * (run + 1);
+        ray.wall_y = y + dy * (run + 1);
+    }
+    while (ray.length < run) {
+        int nx = ray.x + dx;
+        int ny = ray.y + dy;
+        ray.x = nx;
+        ray.y = ny;
+        ray.length++;
+        for (int layer = 0; layer < layer_count; layer++) {
+            if ((mask & (1u << layer)) == 0)
+                continue;
+            for (size_t i : layers[layer]->entities_at(nx, ny)) {
+                if ((layers[layer]->flags[i] & FLAG_DESTROYED) == 0) {
+                    RayHit hit = { layer, i, ray.length };
+                    ray.hits.push_back(hit);
+                }
+            }
+        }
+    }
+}
+
+// Fliegende Schuesse in einem Pool fester Groesse. Jeder Schuss legt pro Tick
+// bis zu speed Kacheln zurueck (per raycast), trifft alle Entitaeten auf der
+// ersten Kachel mit Treffern und verschwindet dann, ebenso an einer Wand oder
+// nach range Kacheln. Ausgeschiedene Schuesse werden mit dem letzten vertauscht.
+class ProjectilePool {
+public:
+    static const int CAPACITY = 64;
+
+private:
+    int _count = 0;
+    int16_t _x[CAPACITY], _y[CAPACITY];
+    uint8_t _direction[CAPACITY];
+    int16_t _range[CAPACITY]; // verbleibende Kacheln
+    uint8_t _speed[CAPACITY]; // Kacheln pro Tick
+    uint8_t _mask[CAPACITY];  // Ebenen, die getroffen werden koennen
+    int16_t _damage[CAPACITY];
+    Ray _ray;
+
+    void retire(int i) {
+        _count--;
+        _x[i] = _x[_count];
+        _y[i] = _y[_count];
+        _direction[i] = _direction[_count];
+        _range[i] = _range[_count];
+        _speed[i] = _speed[_count];
+        _mask[i] = _mask[_count];
+        _damage[i] = _damage[_count];
+    }
+
+public:
+    int size() const {
+        return _count;
+    }
+    int x(int i) const {
+        return _x[i];
+    }
+    int y(int i) const {
+        return _y[i];
+    }
+
+    // Neuer Schuss ab (x, y), false wenn der Pool voll ist
+    bool fire(int x, int y, int direction, int range, int speed, unsigned int mask, int damage) {
+        if (_count == CAPACITY)
+            return false;
+        _x[_count] = static_cast<int16_t>(x);
+        _y[_count] = static_cast<int16_t>(y);
+        _direction[_count] = static_cast<uint8_t>(direction);
+        _range[_count] = static_cast<int16_t>(range);
+        _speed[_count] = static_cast<uint8_t>(speed);
+        _mask[_count] = static_cast<uint8_t>(mask);
+        _damage[_count] = static_cast<int16_t>(damage);
+        _count++;
+        return true;
+    }
+
+    // Bewegt alle Schuesse um einen Tick weiter. Fuer jede getroffene
+    // Entitaet wird ein HitEvent gemeldet, den Schaden rechnet dessen
+    // Verbraucher. Die durchflogenen Kacheln werden an trail angehaengt.
+    void advance(const CollisionGrid& stop, EntityStore* const* layers, int layer_count, std::vector<std::pair<int, int> >& trail,
+                 EventArena<HitEvent>& hits) {
+        int i = 0;
+        while (i < _count) {
+            int steps = _speed[i] < _range[i] ? _speed[i] : _range[i];
+            raycast(_x[i], _y[i], _direction[i], steps, stop, layers, layer_count, _mask[i], _ray);
+            int length = _ray.hits.empty() ? _ray.length : _ray.hits[0].distance;
+            for (const RayHit& hit : _ray.hits) {
+                if (hit.distance != length)
+                    break;
+                HitEvent event = { static_cast<uint8_t>(hit.layer), static_cast<uint32_t>(hit.index), _damage[i] };
+                hits.push(event);
+            }
+
+            int dx, dy;
+            direction_step(_direction[i], dx, dy);
+            for (int step = 1; step <= length; step++)
+                trail.push_back(std::make_pair(_x[i] + dx * step, _y[i] + dy * step));
+            _x[i] = static_cast<int16_t>(_x[i] + dx * length);
+            _y[i] = static_cast<int16_t>(_y[i] + dy * length);
+            _range[i] = static_cast<int16_t>(_range[i] - length);
+
+            if (!_ray.hits.empty() || _ray.blocked || _range[i] == 0)
+                retire(i); // der letzte Schuss rutscht auf i nach und wird als naechstes bewegt
+            else
+                i++;
+        }
+    }
+
+    void clear() {
+        _count = 0;
+    }
+
+    uint64_t hash(uint64_t h) const {
+        for (int i = 0; i < _count; i++) {
+            h = mcigraph::hash_state(h, _x[i]);
+            h = mcigraph::hash_state(h, _y[i]);
+            h = mcigraph::hash_state(h, _direction[i]);
+            h = mcigraph::hash_state(h, _range[i]);
+        }
+        return h;
+    }
+};
+
+// Zeichensystem, optional mit Lebensbalken (max_health > 0)
+inline void draw_entities(const EntityStore& store, int max_health = 0) {
+    for (size_t i = 0; i < store.size(); i++) {
+        int px = store.x[i] * 16;
+        int py = store.y[i] * 16;
+        draw_image(SPRITE_FILES[store.sprite[i]], px, py);
+        if (max_health > 0) {
+            draw_line(px, py - 3, px + (16.0 / max_health) * store.health[i], py - 3, 255, 0);
+            draw_line(px, py - 4, px + (16.0 / max_health) * store.health[i], py - 4, 255, 0);
+        }
+    }
+}
+
+#endif /* WORLD_H */